@@ -0,0 +1,22 @@
+uniform sampler2D texture;
+uniform vec4 texRect;
+
+varying float rotation;
+
+void main()
+{
+    // back from point space into quad space, where corners are at +-1
+    vec2 p = (gl_PointCoord - 0.5) * 2.0 * 1.41421356;
+    float c = cos(rotation);
+    float s = sin(rotation);
+    vec2 q = vec2(p.x * c + p.y * s, p.y * c - p.x * s);
+
+    if (abs(q.x) > 1.0 || abs(q.y) > 1.0)
+        discard;
+
+    // lookup the pixel in the texture rectangle
+    vec4 pixel = texture2D(texture, texRect.xy + (q * 0.5 + 0.5) * texRect.zw);
+
+    // multiply it by the color
+    gl_FragColor = gl_Color * pixel;
+}
@@ -0,0 +1,17 @@
+uniform float scale;
+
+varying float rotation;
+
+void main()
+{
+    // one point per particle, texcoord carries (half size, rotation)
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+    // the point must cover the quad at any rotation, so use its diagonal
+    gl_PointSize = gl_MultiTexCoord0.x * 2.0 * 1.41421356 * scale;
+
+    rotation = radians(gl_MultiTexCoord0.y);
+
+    // forward the vertex color
+    gl_FrontColor = gl_Color;
+}
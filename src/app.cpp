@@ -6,44 +6,124 @@
 #include "imgui-SFML.h"
 #include "alloc.hpp"
 #include "particlefx.hpp"
+#include "pool.hpp"
+#include "particle_batch.hpp"
+#include "effect_pack.hpp"
+#include "texture_loader.hpp"
+#include "texture_atlas.hpp"
 #include "particle_editor.hpp"
+#include "memory_panel.hpp"
+#include "jobs.hpp"
 #include "vec2.hpp"
 
-#define MAX_PARTICLES 32
+// Address space reserved for the emitters, only what is used gets committed
+#define ARENA_RESERVE (size_t(1) << 30)
+
+// Part of the arena the emitters draw their particles and vertices from
+#define PARTICLE_HEAP (size_t(256) << 20)
+
+#define MAX_EMITTERS 64
+
+#define MAX_TEXTURES 64
+
+// Updates an emitter can spend out of every view before it stops building
+// vertices
+#define CULL_DELAY 30
+
+// Sprites packed into the shared atlas, so emitters using them batch together
+const char* ATLAS_IMAGES[] = {
+    "/textures/particle.png",  "/textures/particle2.png", "/textures/particle3.png",
+    "/textures/particle4.png", "/textures/particle5.png", "/textures/particle6.png"
+};
 
 #define P_RADIUS 10
 #define P_SQRADIUS P_RADIUS*P_RADIUS
 
-LinearAllocator* allocator;
-std::vector<ParticleEmitter*> particles;
-size_t active = 0;
+VirtualArenaAllocator* allocator;
+TLSFAllocator* particleHeap;
+std::vector<TrackingAllocator*> trackers;
+Pool<ParticleEmitter>* particles;
+Pool<ParticleEmitter>::Handle active;
+TextureLoader* textures;
 
+EffectPack pack;
+TextureAtlas atlas;
 ParticleEditor editor;
-sf::CircleShape circle;
+MemoryPanel memoryPanel;
+ParticleBatch batch;
+sf::Shader particleShader;
 
 bool dragging = false;
 
+// Decode the atlas images side by side, then pack and upload them
+bool loadAtlas(const std::string& respath)
+{
+    ImageDecoder decoder(IO_THREADS);
+    const size_t numImages = sizeof(ATLAS_IMAGES) / sizeof(ATLAS_IMAGES[0]);
+
+    for(size_t i=0; i<numImages; ++i) {
+        const effect_pack::Entry* entry = pack.find(ATLAS_IMAGES[i]);
+        if(entry && entry->type == effect_pack::TYPE_TEXTURE)
+            decoder.decode(i, pack.getData(*entry), entry->size);
+        else
+            decoder.decode(i, respath + ATLAS_IMAGES[i]);
+    }
+    decoder.wait();
+
+    AtlasBuilder builder;
+    while(auto result = decoder.poll()) {
+        if(result->ok)
+            builder.add(ATLAS_IMAGES[result->id], result->image);
+    }
+
+    return builder.build() && atlas.upload(builder);
+}
+
 bool App::init(const std::string& respath)
 {
-    const size_t allocSize = sizeof(ParticleEmitter) * MAX_PARTICLES;
-    allocator = new LinearAllocator(allocSize, malloc(allocSize));
-
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-    particles.emplace_back(mem::New<ParticleEmitter>(*allocator));
-
-    editor.setup(respath, "/textures/particle.png");
-
-    circle.setRadius(P_RADIUS);
-    circle.setOutlineThickness(1.f);
-    circle.setOutlineColor(sf::Color::Green);
-    circle.setFillColor(sf::Color::Transparent);
+    allocator = new VirtualArenaAllocator(ARENA_RESERVE);
+
+    // resizes come and go, so the particle storage needs a real heap
+    void* heapMemory = allocator->allocate(PARTICLE_HEAP, 16);
+    if(!heapMemory) {
+        delete allocator;
+        return false;
+    }
+    particleHeap = mem::New<TLSFAllocator>(*allocator, PARTICLE_HEAP, heapMemory);
+
+    particles = mem::New<Pool<ParticleEmitter>>(*allocator, MAX_EMITTERS, *allocator);
+    textures = mem::New<TextureLoader>(*allocator, MAX_TEXTURES, IO_THREADS, *allocator);
+
+    // each emitter gets its own tag in the memory panel, and a distinct
+    // stream so the emitters don't overlap exactly
+    for(size_t i=0; i<9; ++i) {
+        trackers.emplace_back(mem::New<TrackingAllocator>(*allocator, *particleHeap, "emitter " + std::to_string(i)));
+        ParticleEmitter& p = (*particles)[particles->create(100, *trackers[i])];
+        p.seed = i+1;
+        p.cullDelay = CULL_DELAY;
+    }
+    active = particles->getHandle(0);
+
+    // expand particles on the GPU when shaders are available
+    if(sf::Shader::isAvailable() &&
+       particleShader.loadFromFile(respath+"/shaders/particle_v.glsl", respath+"/shaders/particle_f.glsl")) {
+        for(auto& p : *particles)
+            p.setShader(&particleShader);
+    }
+
+    // built with --build-pack, effects and images fall back to loose files
+    // without it
+    pack.open(respath+"/effects.pack");
+    loadAtlas(respath);
+
+    sf::Texture* page;
+    sf::IntRect rect;
+    if(atlas.find("/textures/particle.png", page, rect)) {
+        for(auto& p : *particles)
+            p.setTexture(page, rect);
+    }
+
+    editor.setup(respath, "/textures/particle.png", *textures, &pack, &atlas);
 
     reset();
     return true;
@@ -51,8 +131,8 @@ bool App::init(const std::string& respath)
 
 void App::reset()
 {
-    for(auto p : particles)
-        p->resetAll();
+    for(auto& p : *particles)
+        p.resetAll();
 }
 
 void App::input(const sf::Event& event)
@@ -68,10 +148,10 @@ void App::input(const sf::Event& event)
     else
     if(event.type == sf::Event::MouseButtonPressed) {
         const sf::Vector2f mpos = getWindow().mapPixelToCoords(sf::Mouse::getPosition(getWindow()));
-        for(size_t i=0; i<particles.size(); ++i) {
-            float sqDist = vec2::magnitudeSq(particles[i]->emitter - mpos);
+        for(size_t i=0; i<particles->size(); ++i) {
+            float sqDist = vec2::magnitudeSq(particles->begin()[i].emitter - mpos);
             if(sqDist < P_SQRADIUS) {
-                active = i;
+                active = particles->getHandle(i);
                 dragging = true;
             }
         }
@@ -86,15 +166,19 @@ void App::fixed(float t, float dt)
 
 void App::update(const sf::Time& elapsed)
 {
-    ParticleEmitter* current = particles[active];
+    ParticleEmitter* current = &(*particles)[active];
 
     if(dragging) {
         const sf::Vector2f mpos = getWindow().mapPixelToCoords(sf::Mouse::getPosition(getWindow()));
         vec2::lerp(current->emitter, current->emitter, mpos, 0.2f);
     }
 
-    for(auto p : particles)
-        p->update(elapsed);
+    // emitters are independent, update them in parallel
+    JobSystem& jobs = JobSystem::get();
+    JobSystem::Counter counter;
+    for(auto& p : *particles)
+        jobs.run([&p, &elapsed]() { p.update(elapsed); }, counter);
+    jobs.wait(counter);
 
     if (ImGui::BeginMainMenuBar())
     {
@@ -102,12 +186,25 @@ void App::update(const sf::Time& elapsed)
         {
             if(ImGui::MenuItem("Open")) editor.open(*current);
             if(ImGui::MenuItem("Save")) editor.save(*current);
+            if(ImGui::BeginMenu("Library", pack.isOpen()))
+            {
+                for(size_t i=0; i<pack.getNumEntries(); ++i) {
+                    const effect_pack::Entry* e = pack.getEntry(i);
+                    if(e && e->type == effect_pack::TYPE_EFFECT && ImGui::MenuItem(pack.getName(*e)))
+                        editor.open(*current, pack.getName(*e));
+                }
+                ImGui::EndMenu();
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
     }
 
+    // images decoded since the last frame
+    textures->update();
+
     editor.update(*current, elapsed);
+    memoryPanel.update();
 }
 
 void App::pre_draw()
@@ -116,13 +213,25 @@ void App::pre_draw()
 
 void App::draw(const sf::View& view)
 {
-    getWindow().setView(view);
-    for(auto p : particles) {
-        getWindow().draw(*p);
+    // only what this view can see goes into its batch
+    const sf::FloatRect area = ParticleBatch::getViewBounds(view);
 
-        circle.setPosition(p->emitter-sf::Vector2f(P_RADIUS, P_RADIUS));
-        getWindow().draw(circle);
+    batch.clear();
+    for(auto& p : *particles) {
+        if(ParticleBatch::isVisible(p, area)) {
+            p.markVisible();
+            batch.add(p);
+        }
     }
+    for(const auto& p : *particles) {
+        const sf::FloatRect gizmo(p.emitter.x - P_RADIUS - 1, p.emitter.y - P_RADIUS - 1, 2*P_RADIUS + 2, 2*P_RADIUS + 2);
+        if(gizmo.intersects(area))
+            batch.addCircle(p.emitter, P_RADIUS, sf::Color::Green);
+    }
+    batch.build();
+
+    getWindow().setView(view);
+    getWindow().draw(batch);
 }
 
 void App::post_draw()
@@ -130,17 +239,49 @@ void App::post_draw()
 
 void App::clean()
 {
+    mem::Delete(*allocator, *particles);
+
+    // before the pack, its decoder threads may still read from it
+    mem::Delete(*allocator, *textures);
+
+    for(auto t : trackers)
+        mem::Delete(*allocator, *t);
+    trackers.clear();
+
+    void* heapMemory = particleHeap->getStart();
+    mem::Delete(*allocator, *particleHeap);
+    allocator->deallocate(heapMemory);
+
+    atlas.clear();
+    pack.close();
+
+    delete allocator;
 }
 
 /// Main
 #include "core/engine.hpp"
+#include "bench/headless.hpp"
+#include "bench/alloc_bench.hpp"
+#include "editor/effect_convert.hpp"
 
 int main(int argc, char ** args)
 {
     if (argc < 2) {
-        std::cout << "Please specify a res path!\n";
+        std::cout << "Please specify a res path, or --headless / --bench-alloc / --convert-pfx / --build-pack to run without a window!\n";
         return EXIT_FAILURE;
     }
 
+    if (std::string(args[1]) == "--headless")
+        return bench::runHeadless(argc-2, args+2);
+
+    if (std::string(args[1]) == "--bench-alloc")
+        return bench::runAllocBench(argc-2, args+2);
+
+    if (std::string(args[1]) == "--convert-pfx")
+        return tools::runConvert(argc-2, args+2);
+
+    if (std::string(args[1]) == "--build-pack")
+        return tools::runBuildPack(argc-2, args+2);
+
     return Engine::start<App>(args[1]);
 }
@@ -0,0 +1,567 @@
+#include "alloc_bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "alloc.hpp"
+#include "random.hpp"
+
+// std::pmr only exists from C++17 on, the build compiles this file as C++17
+// when it can and the comparison is simply left out otherwise
+#if defined(__has_include)
+    #if __has_include(<memory_resource>) && __cplusplus >= 201703L
+        #define ALLOC_BENCH_PMR 1
+        #include <memory_resource>
+    #endif
+#endif
+#ifndef ALLOC_BENCH_PMR
+    #define ALLOC_BENCH_PMR 0
+#endif
+
+namespace bench
+{
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const size_t ALIGNMENT = 8;
+
+    // Largest request the small object patterns make, also the pool slot size
+    const size_t SMALL_MAX = 256;
+
+    /// Patterns
+    // A pattern is recorded once as a script of operations on numbered
+    // slots, so every allocator replays exactly the same requests.
+    enum Order
+    {
+        ORDER_FIFO   = 1<<0,    // freed in allocation order
+        ORDER_LIFO   = 1<<1,    // freed in reverse order, per frame
+        ORDER_RANDOM = 1<<2     // freed in any order
+    };
+
+    enum OpType
+    {
+        OP_ALLOC,
+        OP_FREE,
+        OP_FRAME                // every earlier allocation has been freed
+    };
+
+    struct Op
+    {
+        u32 type;
+        u32 slot;
+        u32 size;
+    };
+
+    struct Pattern
+    {
+        const char*     name;
+        u32             order;
+        size_t          maxSize;
+        size_t          slots;
+        size_t          allocs;
+        std::vector<Op> ops;
+    };
+
+    u32 randomSize(Random& random, u32 min, u32 max)
+    {
+        // multiples of 8 in [min, max], the way objects tend to be sized
+        return min + (random.next() % ((max-min)/8 + 1)) * 8;
+    }
+
+    void push(Pattern& pattern, u32 type, u32 slot, u32 size = 0)
+    {
+        Op op = { type, slot, size };
+        pattern.ops.push_back(op);
+
+        if(type == OP_ALLOC)
+            pattern.allocs++;
+    }
+
+    // Many small emitter sized objects created up front and released in
+    // the same order, like loading and unloading a scene
+    Pattern makeSmall(size_t numOps, Random& random)
+    {
+        static const u32 sizes[] = { 16, 24, 32, 48, 64, 96, 128, 192, 256 };
+
+        Pattern pattern = { "small", ORDER_FIFO, SMALL_MAX, numOps/2, 0, {} };
+
+        for(size_t i=0; i<pattern.slots; ++i)
+            push(pattern, OP_ALLOC, i, sizes[random.next() % (sizeof(sizes)/sizeof(sizes[0]))]);
+        for(size_t i=0; i<pattern.slots; ++i)
+            push(pattern, OP_FREE, i);
+        push(pattern, OP_FRAME, 0);
+
+        return pattern;
+    }
+
+    // Scratch memory of a frame, taken during the frame and given back
+    // in reverse before the next one starts
+    Pattern makeFrames(size_t numOps, Random& random)
+    {
+        const size_t perFrame = 64;
+
+        Pattern pattern = { "frames", ORDER_LIFO, SMALL_MAX, perFrame, 0, {} };
+
+        for(size_t n=0; n<numOps; n+=perFrame*2)
+        {
+            for(size_t i=0; i<perFrame; ++i)
+                push(pattern, OP_ALLOC, i, randomSize(random, 16, SMALL_MAX));
+            for(size_t i=perFrame; i-- > 0; )
+                push(pattern, OP_FREE, i);
+            push(pattern, OP_FRAME, 0);
+        }
+
+        return pattern;
+    }
+
+    // Small objects freed in random order, e.g. emitters dying independently
+    Pattern makeRandom(size_t numOps, Random& random)
+    {
+        Pattern pattern = { "random", ORDER_RANDOM, SMALL_MAX, numOps/2, 0, {} };
+
+        std::vector<u32> order(pattern.slots);
+        for(size_t i=0; i<pattern.slots; ++i) {
+            push(pattern, OP_ALLOC, i, randomSize(random, 16, SMALL_MAX));
+            order[i] = i;
+        }
+
+        for(size_t i=order.size(); i > 1; --i)
+            std::swap(order[i-1], order[random.next() % i]);
+
+        for(size_t i=0; i<order.size(); ++i)
+            push(pattern, OP_FREE, order[i]);
+        push(pattern, OP_FRAME, 0);
+
+        return pattern;
+    }
+
+    // A live set of mixed sizes where one block is replaced at a time, which
+    // is what fragments a general purpose heap over a long session
+    Pattern makeChurn(size_t numOps, Random& random)
+    {
+        const size_t live = std::max<size_t>(1, std::min<size_t>(4096, numOps/4));
+
+        Pattern pattern = { "churn", ORDER_RANDOM, 2048, live, 0, {} };
+
+        for(size_t i=0; i<live; ++i)
+            push(pattern, OP_ALLOC, i, randomSize(random, 16, 2048));
+
+        while(pattern.ops.size() + live + 2 <= numOps)
+        {
+            const u32 slot = random.next() % live;
+            push(pattern, OP_FREE, slot);
+            push(pattern, OP_ALLOC, slot, randomSize(random, 16, 2048));
+        }
+
+        for(size_t i=0; i<live; ++i)
+            push(pattern, OP_FREE, i);
+        push(pattern, OP_FRAME, 0);
+
+        return pattern;
+    }
+
+    /// Subjects
+    // Common face of everything being measured. Sizes are passed back on
+    // free because the pmr resources need them.
+    class Subject
+    {
+    public:
+        Subject(const char* name, u32 orders, size_t maxSize)
+            : name(name), orders(orders), maxSize(maxSize) {}
+        virtual ~Subject() {}
+
+        virtual void* allocate(size_t size) = 0;
+
+        virtual void deallocate(void* p, size_t size) = 0;
+
+        // All allocations are gone, reclaim whatever is left
+        virtual void endFrame() {}
+
+        // Bytes currently held including overhead, 0 when unknown
+        virtual size_t getUsedMemory() const { return 0; }
+
+        bool supports(const Pattern& pattern) const
+        {
+            return (orders & pattern.order) && pattern.maxSize <= maxSize;
+        }
+
+        const char* name;
+
+    private:
+        u32    orders;
+        size_t maxSize;
+    };
+
+    class MallocSubject : public Subject
+    {
+    public:
+        MallocSubject() : Subject("malloc", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, ~size_t(0)) {}
+
+        void* allocate(size_t size) override { return malloc(size); }
+
+        void deallocate(void* p, size_t) override { free(p); }
+    };
+
+    // Any of the engine allocators that can free individual blocks
+    class AllocatorSubject : public Subject
+    {
+    public:
+        AllocatorSubject(const char* name, u32 orders, size_t maxSize, Allocator& allocator)
+            : Subject(name, orders, maxSize), allocator(allocator) {}
+
+        void* allocate(size_t size) override { return allocator.allocate(size, ALIGNMENT); }
+
+        void deallocate(void* p, size_t) override { allocator.deallocate(p); }
+
+        size_t getUsedMemory() const override { return allocator.getUsedMemory(); }
+
+    private:
+        Allocator& allocator;
+    };
+
+    // Individual frees are no-ops, the whole buffer is cleared per frame
+    class LinearSubject : public Subject
+    {
+    public:
+        LinearSubject(LinearAllocator& allocator)
+            : Subject("linear", ORDER_FIFO|ORDER_LIFO, ~size_t(0)), allocator(allocator) {}
+
+        void* allocate(size_t size) override { return allocator.allocate(size, ALIGNMENT); }
+
+        void deallocate(void*, size_t) override {}
+
+        void endFrame() override { allocator.clear(); }
+
+        size_t getUsedMemory() const override { return allocator.getUsedMemory(); }
+
+    private:
+        LinearAllocator& allocator;
+    };
+
+    // Linear over reserved address space, pages are kept between frames
+    class VirtualArenaSubject : public Subject
+    {
+    public:
+        VirtualArenaSubject(VirtualArenaAllocator& allocator)
+            : Subject("virtual_arena", ORDER_FIFO|ORDER_LIFO, ~size_t(0)), allocator(allocator) {}
+
+        void* allocate(size_t size) override { return allocator.allocate(size, ALIGNMENT); }
+
+        void deallocate(void*, size_t) override {}
+
+        void endFrame() override { allocator.reset(false); }
+
+        size_t getUsedMemory() const override { return allocator.getUsedMemory(); }
+
+    private:
+        VirtualArenaAllocator& allocator;
+    };
+
+    // Every request takes a whole slot, like a size class of a real heap
+    class PoolSubject : public Subject
+    {
+    public:
+        PoolSubject(const char* name, Allocator& allocator)
+            : Subject(name, ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, SMALL_MAX), allocator(allocator) {}
+
+        void* allocate(size_t) override { return allocator.allocate(SMALL_MAX, ALIGNMENT); }
+
+        void deallocate(void* p, size_t) override { allocator.deallocate(p); }
+
+        size_t getUsedMemory() const override { return allocator.getUsedMemory(); }
+
+    private:
+        Allocator& allocator;
+    };
+
+#if ALLOC_BENCH_PMR
+    class PmrSubject : public Subject
+    {
+    public:
+        PmrSubject(const char* name, u32 orders, std::pmr::memory_resource& resource,
+                   std::pmr::monotonic_buffer_resource* monotonic = nullptr)
+            : Subject(name, orders, ~size_t(0)), resource(resource), monotonic(monotonic) {}
+
+        void* allocate(size_t size) override
+        {
+            try {
+                return resource.allocate(size, ALIGNMENT);
+            }
+            catch(const std::bad_alloc&) {
+                return nullptr;
+            }
+        }
+
+        void deallocate(void* p, size_t size) override { resource.deallocate(p, size, ALIGNMENT); }
+
+        void endFrame() override
+        {
+            if(monotonic)
+                monotonic->release();
+        }
+
+    private:
+        std::pmr::memory_resource&           resource;
+        std::pmr::monotonic_buffer_resource* monotonic;
+    };
+#endif
+
+    /// Runs
+    struct Latency
+    {
+        Latency() : p50(0), p90(0), p99(0), max(0) {}
+
+        u64 p50, p90, p99, max;
+    };
+
+    struct Result
+    {
+        Result() : ns(0), failed(0), peakUsed(0) {}
+
+        u64     ns;
+        size_t  failed;
+        size_t  peakUsed;
+        Latency alloc;
+        Latency free;
+    };
+
+    inline u64 elapsedNs(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    inline void execute(Subject& subject, const Op& op, std::vector<void*>& slots,
+                        std::vector<u32>& sizes, size_t& failed)
+    {
+        switch(op.type)
+        {
+        case OP_ALLOC:
+            slots[op.slot] = subject.allocate(op.size);
+            sizes[op.slot] = op.size;
+            if(slots[op.slot] == nullptr)
+                ++failed;
+            break;
+
+        case OP_FREE:
+            if(slots[op.slot] != nullptr)
+                subject.deallocate(slots[op.slot], sizes[op.slot]);
+            slots[op.slot] = nullptr;
+            break;
+
+        default:
+            subject.endFrame();
+            break;
+        }
+    }
+
+    Latency percentiles(std::vector<u32>& samples)
+    {
+        Latency latency;
+        if(samples.empty())
+            return latency;
+
+        std::sort(samples.begin(), samples.end());
+
+        const size_t last = samples.size()-1;
+        latency.p50 = samples[last*50/100];
+        latency.p90 = samples[last*90/100];
+        latency.p99 = samples[last*99/100];
+        latency.max = samples[last];
+        return latency;
+    }
+
+    // One untimed warm-up pass, one pass timed as a whole for throughput
+    // and one pass with every operation timed for the latency percentiles
+    Result run(Subject& subject, const Pattern& pattern)
+    {
+        Result result;
+        std::vector<void*> slots(pattern.slots, nullptr);
+        std::vector<u32> sizes(pattern.slots, 0);
+        size_t failed = 0;
+
+        for(const Op& op : pattern.ops)
+            execute(subject, op, slots, sizes, failed);
+
+        failed = 0;
+        const Clock::time_point start = Clock::now();
+        for(const Op& op : pattern.ops)
+            execute(subject, op, slots, sizes, failed);
+        result.ns = elapsedNs(start, Clock::now());
+        result.failed = failed;
+
+        std::vector<u32> allocNs, freeNs;
+        allocNs.reserve(pattern.allocs);
+        freeNs.reserve(pattern.allocs);
+
+        for(const Op& op : pattern.ops)
+        {
+            const Clock::time_point t0 = Clock::now();
+            execute(subject, op, slots, sizes, failed);
+            const u64 ns = elapsedNs(t0, Clock::now());
+
+            if(op.type == OP_ALLOC) {
+                allocNs.push_back(ns);
+                result.peakUsed = std::max(result.peakUsed, subject.getUsedMemory());
+            }
+            else if(op.type == OP_FREE)
+                freeNs.push_back(ns);
+        }
+
+        result.alloc = percentiles(allocNs);
+        result.free  = percentiles(freeNs);
+        return result;
+    }
+
+    // Cost of a pair of clock reads, included in every latency sample
+    u64 measureClockOverhead()
+    {
+        std::vector<u32> samples(10000);
+        for(size_t i=0; i<samples.size(); ++i)
+        {
+            const Clock::time_point t0 = Clock::now();
+            samples[i] = elapsedNs(t0, Clock::now());
+        }
+        return percentiles(samples).p50;
+    }
+
+    void printLatency(const char* name, const Latency& latency)
+    {
+        printf("\"%s\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}", name,
+               (unsigned long long)latency.p50, (unsigned long long)latency.p90,
+               (unsigned long long)latency.p99, (unsigned long long)latency.max);
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: Particles --bench-alloc [options]\n"
+                  << "  --ops N       operations per pattern (100000)\n"
+                  << "  --seed N      seed of the recorded patterns\n"
+                  << "  --arena MB    memory handed to each engine allocator (64)\n";
+    }
+}
+
+int runAllocBench(int argc, char** args)
+{
+    size_t numOps = 100000;
+    u32 seed = 0;
+    size_t arenaSize = 64 << 20;
+
+    for(int i=0; i<argc; ++i)
+    {
+        const std::string arg = args[i];
+        const bool hasValue = i+1 < argc;
+
+        if(arg == "--ops" && hasValue)
+            numOps = strtoul(args[++i], nullptr, 10);
+        else if(arg == "--seed" && hasValue)
+            seed = strtoul(args[++i], nullptr, 10);
+        else if(arg == "--arena" && hasValue)
+            arenaSize = strtoul(args[++i], nullptr, 10) << 20;
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(numOps < 4 || arenaSize == 0) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    Random random(seed);
+    std::vector<Pattern> patterns;
+    patterns.push_back(makeSmall(numOps, random));
+    patterns.push_back(makeFrames(numOps, random));
+    patterns.push_back(makeRandom(numOps, random));
+    patterns.push_back(makeChurn(numOps, random));
+
+    // every engine allocator gets its own arena so none of them starts warm
+    std::vector<void*> arenas;
+    for(int i=0; i<7; ++i)
+        arenas.push_back(malloc(arenaSize));
+
+    LinearAllocator   linear(arenaSize, arenas[0]);
+    StackAllocator    stack(arenaSize, arenas[1]);
+    FreeListAllocator freeList(arenaSize, arenas[2]);
+    PoolAllocator     pool(SMALL_MAX, ALIGNMENT, arenaSize, arenas[3]);
+    TLSFAllocator     tlsf(arenaSize, arenas[4]);
+    FreeListAllocator proxied(arenaSize, arenas[5]);
+    ConcurrentPoolAllocator concurrentPool(SMALL_MAX, ALIGNMENT, arenaSize, arenas[6]);
+    VirtualArenaAllocator   virtualArena(arenaSize);
+    ProxyAllocator    proxy(proxied);
+
+    MallocSubject    mallocSubject;
+    LinearSubject    linearSubject(linear);
+    VirtualArenaSubject virtualArenaSubject(virtualArena);
+    AllocatorSubject stackSubject("stack", ORDER_LIFO, ~size_t(0), stack);
+    AllocatorSubject freeListSubject("free_list", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, ~size_t(0), freeList);
+    AllocatorSubject tlsfSubject("tlsf", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, ~size_t(0), tlsf);
+    PoolSubject      poolSubject("pool", pool);
+    PoolSubject      concurrentPoolSubject("concurrent_pool", concurrentPool);
+    AllocatorSubject proxySubject("proxy", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, ~size_t(0), proxy);
+
+    std::vector<Subject*> subjects = { &mallocSubject, &linearSubject, &virtualArenaSubject, &stackSubject,
+                                       &freeListSubject, &tlsfSubject, &poolSubject,
+                                       &concurrentPoolSubject, &proxySubject };
+
+#if ALLOC_BENCH_PMR
+    // the monotonic resource gets the same fixed buffer as the linear allocator
+    std::vector<u8> monotonicBuffer(arenaSize);
+    std::pmr::monotonic_buffer_resource monotonic(monotonicBuffer.data(), monotonicBuffer.size(),
+                                                  std::pmr::null_memory_resource());
+    std::pmr::unsynchronized_pool_resource unsynchronizedPool;
+
+    PmrSubject monotonicSubject("pmr_monotonic", ORDER_FIFO|ORDER_LIFO, monotonic, &monotonic);
+    PmrSubject poolResourceSubject("pmr_unsynchronized_pool", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, unsynchronizedPool);
+    PmrSubject newDeleteSubject("pmr_new_delete", ORDER_FIFO|ORDER_LIFO|ORDER_RANDOM, *std::pmr::new_delete_resource());
+
+    subjects.push_back(&monotonicSubject);
+    subjects.push_back(&poolResourceSubject);
+    subjects.push_back(&newDeleteSubject);
+#endif
+
+    printf("{\"ops\":%zu,\"seed\":%u,\"arena_bytes\":%zu,\"pmr\":%s,\"clock_overhead_ns\":%llu,\"results\":[",
+           numOps, seed, arenaSize, ALLOC_BENCH_PMR ? "true" : "false",
+           (unsigned long long)measureClockOverhead());
+
+    bool first = true;
+    for(const Pattern& pattern : patterns)
+    {
+        for(Subject* subject : subjects)
+        {
+            if(!subject->supports(pattern))
+                continue;
+
+            const Result result = run(*subject, pattern);
+
+            printf("%s{\"allocator\":\"%s\",\"pattern\":\"%s\",\"ops\":%zu,\"ms\":%.3f,\"mops_per_sec\":%.2f,"
+                   "\"failed\":%zu,\"peak_used_bytes\":%zu,",
+                   first ? "" : ",", subject->name, pattern.name, pattern.ops.size(), result.ns / 1e6,
+                   result.ns > 0 ? pattern.ops.size() * 1e3 / result.ns : 0.0,
+                   result.failed, result.peakUsed);
+            printLatency("alloc_ns", result.alloc);
+            std::cout << ",";
+            printLatency("free_ns", result.free);
+            std::cout << "}";
+            std::cout.flush();
+
+            first = false;
+        }
+    }
+
+    std::cout << "]}\n";
+
+    for(void* arena : arenas)
+        free(arena);
+
+    return EXIT_SUCCESS;
+}
+
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+namespace bench
+{
+    // Allocator microbenchmarks, see runAllocBench() for the options.
+    // Prints a JSON report to stdout and returns the process exit code.
+    int runAllocBench(int argc, char** args);
+}
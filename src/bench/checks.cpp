@@ -0,0 +1,362 @@
+#include "checks.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "alloc.hpp"
+#include "pool.hpp"
+#include "particlefx.hpp"
+#include "particle_batch.hpp"
+#include "texture_loader.hpp"
+#include "texture_atlas.hpp"
+
+namespace bench
+{
+
+namespace
+{
+    // Counts and reports an expectation that doesn't hold
+    void expect(bool condition, const char* check, const char* what, size_t& failures)
+    {
+        if(condition)
+            return;
+
+        std::cerr << check << ": expected " << what << "\n";
+        ++failures;
+    }
+
+    // Emitters on their own trackers, like the app's. Destroying one moves
+    // the last emitter into its slot, which must carry all of the moved
+    // emitter's memory along and leave the destroyed one's handle stale.
+    size_t checkPool()
+    {
+        const char* name = "pool";
+        size_t failures = 0;
+
+        const size_t heapSize = 4 << 20;
+        void* heapMemory = malloc(heapSize);
+        TLSFAllocator heap(heapSize, heapMemory);
+        {
+            TrackingAllocator trackerA(heap, "check a"), trackerB(heap, "check b"), trackerC(heap, "check c");
+
+            Pool<ParticleEmitter> pool(4, heap);
+            const Pool<ParticleEmitter>::Handle a = pool.create(100, trackerA);
+            const Pool<ParticleEmitter>::Handle b = pool.create(200, trackerB);
+            const Pool<ParticleEmitter>::Handle c = pool.create(300, trackerC);
+            expect(!a.isNull() && !b.isNull() && !c.isNull() && pool.size() == 3, name, "three live emitters", failures);
+
+            const size_t usedB = trackerB.getUsedMemory();
+            const size_t usedC = trackerC.getUsedMemory();
+
+            pool.destroy(a);
+
+            expect(pool.size() == 2, name, "two emitters after destroy", failures);
+            expect(!pool.isValid(a) && pool.get(a) == nullptr, name, "the destroyed handle to be stale", failures);
+            expect(pool.get(b) && pool.get(b)->getCount() == 200, name, "the untouched handle to resolve", failures);
+            expect(pool.get(c) && pool.get(c)->getCount() == 300, name, "the moved emitter's handle to follow it", failures);
+            expect(trackerA.getUsedMemory() == 0 && trackerA.getNumAllocations() == 0, name,
+                   "the destroyed emitter's tracker to be empty", failures);
+            expect(trackerB.getUsedMemory() == usedB, name, "the untouched emitter's memory to stay", failures);
+            expect(trackerC.getUsedMemory() == usedC, name, "the moved emitter's memory to stay on its tracker", failures);
+
+            // the moved emitter still works and grows on its own tracker
+            if(ParticleEmitter* moved = pool.get(c)) {
+                moved->resetAll();
+                moved->update(sf::seconds(1.f/60.f));
+                expect(moved->resize(400) && moved->getCount() == 400, name, "the moved emitter to resize", failures);
+                expect(trackerA.getUsedMemory() == 0, name, "nothing billed to the destroyed emitter's tracker", failures);
+            }
+
+            // the freed slot is reused under a new generation
+            const Pool<ParticleEmitter>::Handle d = pool.create(50, trackerA);
+            expect(!d.isNull() && d.getIndex() == a.getIndex() && d != a, name, "the slot to come back with a new generation", failures);
+            expect(!pool.isValid(a) && pool.get(d) && pool.get(d)->getCount() == 50, name,
+                   "the stale handle to stay stale after reuse", failures);
+
+            pool.clear();
+            expect(pool.size() == 0 && !pool.isValid(b) && !pool.isValid(c) && !pool.isValid(d), name,
+                   "clear() to make every handle stale", failures);
+            expect(trackerA.getUsedMemory() == 0 && trackerB.getUsedMemory() == 0 && trackerC.getUsedMemory() == 0, name,
+                   "every tracker to be empty after clear()", failures);
+        }
+        free(heapMemory);
+
+        return failures;
+    }
+
+    // Whether the batch holds `emitter`'s vertices from `first` on, moved
+    // through its transform
+    bool sameTransformed(const ParticleBatch& batch, size_t first, const ParticleEmitter& emitter)
+    {
+        const sf::Transform& transform = emitter.getTransform();
+        const sf::Vertex* in  = emitter.getVertices();
+        const sf::Vertex* out = batch.getVertices() + first;
+
+        for(size_t i=0; i<emitter.getVertexCount(); ++i) {
+            const sf::Vector2f p = transform.transformPoint(in[i].position);
+            if(std::abs(out[i].position.x - p.x) > 1e-3f || std::abs(out[i].position.y - p.y) > 1e-3f ||
+               out[i].color != in[i].color || out[i].texCoords != in[i].texCoords)
+                return false;
+        }
+        return true;
+    }
+
+    // Emitters and a gizmo with known keys, grouped by (texture, blend mode)
+    // in order of first appearance. The textures are only compared, never
+    // uploaded, so no GPU is needed.
+    size_t checkBatch()
+    {
+        const char* name = "batch";
+        size_t failures = 0;
+
+        sf::Texture page, other;
+
+        // two regions of one page share a group, another blend mode or
+        // texture starts a new one
+        ParticleEmitter a(10), b(5), c(7), d(3);
+        a.setTexture(&page, sf::IntRect(0, 0, 16, 16));
+        b.setTexture(&page, sf::IntRect(0, 0, 16, 16));
+        b.blendMode = sf::BlendAlpha;
+        c.setTexture(&other, sf::IntRect(0, 0, 8, 8));
+        d.setTexture(&page, sf::IntRect(16, 0, 16, 16));
+
+        b.setPosition(100, 50);
+        c.setScale(2, 2);
+        d.setPosition(-20, 30);
+        d.setRotation(90);
+
+        for(ParticleEmitter* emitter : { &a, &b, &c, &d })
+            emitter->resetAll();
+
+        ParticleBatch batch;
+        batch.add(a);
+        batch.add(b);
+        batch.add(c);
+        batch.add(d);
+        batch.addCircle(sf::Vector2f(5, 5), 10, sf::Color::White);
+        batch.build();
+
+        const mem::Vector<ParticleBatch::Group>& groups = batch.getGroups();
+        expect(groups.size() == 4, name, "four groups", failures);
+        if(groups.size() != 4)
+            return failures;
+
+        const size_t counts[] = { (10+3)*4, 5*4, 7*4, BATCH_CIRCLE_POINTS*4 };
+        const sf::Texture* textures[] = { &page, &page, &other, nullptr };
+        size_t first = 0;
+        for(size_t g=0; g<groups.size(); ++g) {
+            expect(groups[g].count == counts[g], name, "the vertices of each group's items", failures);
+            expect(groups[g].first == first, name, "the groups packed in order", failures);
+            expect(groups[g].texture == textures[g], name, "each group's texture", failures);
+            expect(groups[g].primitive == sf::Quads && groups[g].shader == nullptr, name, "quads without a shader", failures);
+            first += groups[g].count;
+        }
+        expect(batch.getVertexCount() == first, name, "every vertex in a group", failures);
+        expect(groups[1].blendMode == sf::BlendAlpha && groups[3].blendMode == sf::BlendAlpha, name,
+               "alpha blending for the second emitter and the gizmo", failures);
+
+        // items keep their order within a group, transforms are applied
+        expect(sameTransformed(batch, groups[0].first, a), name, "the untransformed emitter copied as is", failures);
+        expect(sameTransformed(batch, groups[0].first + 10*4, d), name, "the rotated emitter after the first one", failures);
+        expect(sameTransformed(batch, groups[1].first, b), name, "the translated emitter in world space", failures);
+        expect(sameTransformed(batch, groups[2].first, c), name, "the scaled emitter in world space", failures);
+
+        // the second region's coordinates survive the shared group
+        const sf::Vertex* dVertices = batch.getVertices() + groups[0].first + 10*4;
+        expect(dVertices[0].texCoords == sf::Vector2f(16, 0) && dVertices[2].texCoords == sf::Vector2f(32, 16), name,
+               "the second region's texture coordinates", failures);
+
+        // a rebuild from the same items gives the same batch
+        batch.clear();
+        batch.add(a);
+        batch.build();
+        expect(batch.getGroups().size() == 1 && batch.getVertexCount() == 10*4, name, "a cleared batch to start over", failures);
+
+        return failures;
+    }
+
+    bool samePixels(const sf::Image& a, const sf::Image& b)
+    {
+        const sf::Vector2u size = a.getSize();
+        return size == b.getSize() && size.x > 0 && size.y > 0 &&
+               memcmp(a.getPixelsPtr(), b.getPixelsPtr(), size.x * size.y * 4) == 0;
+    }
+
+    // The decode half of texture loading, which never touches the GPU: a
+    // bundled image from its file and from memory, a missing file, and a
+    // request released before its image is decoded
+    size_t checkDecoder(const std::string& resPath)
+    {
+        const char* name = "decoder";
+        size_t failures = 0;
+
+        const std::string path = resPath + "/textures/particle.png";
+        std::ifstream is(path, std::ios::binary);
+        const std::vector<char> bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        expect(!bytes.empty(), name, "the bundled image to be readable", failures);
+        if(bytes.empty())
+            return failures;
+
+        {
+            ImageDecoder decoder(2);
+            decoder.decode(1, path);
+            decoder.decode(2, bytes.data(), bytes.size());
+            decoder.decode(3, resPath + "/textures/missing.png");
+
+            // results come back in completion order, by id here
+            std::unique_ptr<ImageDecoder::Result> results[3];
+            for(size_t polls=0; polls<1000 && (!results[0] || !results[1] || !results[2]); ++polls) {
+                std::unique_ptr<ImageDecoder::Result> result = decoder.poll();
+                if(!result)
+                    decoder.wait();
+                else if(result->id >= 1 && result->id <= 3)
+                    results[result->id-1] = std::move(result);
+            }
+
+            expect(results[0] && results[0]->ok, name, "the image decoded from its file", failures);
+            expect(results[1] && results[1]->ok, name, "the image decoded from memory", failures);
+            expect(results[2] && !results[2]->ok, name, "the missing file to fail", failures);
+            if(results[0] && results[1])
+                expect(samePixels(results[0]->image, results[1]->image), name, "the same pixels from file and memory", failures);
+            expect(decoder.getPending() == 0 && !decoder.poll(), name, "nothing left after every result", failures);
+        }
+
+        {
+            // nothing below is uploaded, the only image that decodes is
+            // released first and a failed decode creates no texture
+            TextureLoader loader(4, 1);
+            const TextureLoader::Handle released = loader.load(bytes.data(), bytes.size());
+            loader.release(released);
+            expect(loader.getState(released) == TextureLoader::FAILED, name, "a released handle to read as failed", failures);
+
+            // the released slot comes back while its image is still decoding
+            const TextureLoader::Handle reused = loader.load(resPath + "/textures/missing.png");
+            expect(!reused.isNull() && reused.getIndex() == released.getIndex() && reused != released, name,
+                   "the released slot reused under a new generation", failures);
+            expect(loader.getState(reused) == TextureLoader::LOADING, name, "a new load to be in progress", failures);
+
+            loader.finish();
+            expect(loader.getDecoder().getPending() == 0 && !loader.getDecoder().poll(), name,
+                   "the released image's result to be consumed", failures);
+            expect(loader.getState(released) == TextureLoader::FAILED, name, "the released handle to stay failed", failures);
+            expect(loader.getState(reused) == TextureLoader::FAILED, name,
+                   "the released image discarded instead of landing in the reused slot", failures);
+
+            loader.release(reused);
+        }
+
+        return failures;
+    }
+
+    bool sameRegions(const AtlasBuilder& a, const AtlasBuilder& b)
+    {
+        if(a.getRegions().size() != b.getRegions().size())
+            return false;
+
+        for(const auto& region : a.getRegions()) {
+            const AtlasBuilder::Region* other = b.find(region.first);
+            if(other == nullptr || other->page != region.second.page || other->rect != region.second.rect)
+                return false;
+        }
+        return true;
+    }
+
+    // The same images added in three orders, on small pages so they spill
+    // over several, with equal sizes that only the names tell apart
+    size_t checkAtlas()
+    {
+        const char* name = "atlas";
+        size_t failures = 0;
+
+        const unsigned pageSize = 64;
+        const unsigned sizes[][2] = { {20, 10}, {10, 20}, {20, 10}, {30, 30}, {5, 5}, {5, 5}, {5, 5},
+                                      {40, 12}, {12, 40}, {63, 8}, {8, 63}, {20, 10}, {31, 17} };
+        const size_t numImages = sizeof(sizes)/sizeof(sizes[0]);
+
+        std::vector<std::string> names;
+        std::vector<sf::Image> images(numImages);
+        for(size_t i=0; i<numImages; ++i) {
+            names.push_back("image" + std::to_string(i));
+            images[i].create(sizes[i][0], sizes[i][1], sf::Color(10 + i*15, 255 - i*10, i*3));
+        }
+
+        AtlasBuilder forward(pageSize), backward(pageSize), interleaved(pageSize);
+        for(size_t i=0; i<numImages; ++i) {
+            forward.add(names[i], images[i]);
+            backward.add(names[numImages-1-i], images[numImages-1-i]);
+
+            const size_t j = (i*5) % numImages;
+            interleaved.add(names[j], images[j]);
+        }
+
+        const bool built = forward.build() && backward.build() && interleaved.build();
+        expect(built, name, "every image to fit", failures);
+        if(!built)
+            return failures;
+
+        expect(forward.getNumPages() > 1, name, "the images to spill over several pages", failures);
+        expect(forward.getRegions().size() == numImages, name, "a region per image", failures);
+        expect(sameRegions(forward, backward) && sameRegions(forward, interleaved), name,
+               "the same regions whatever the insertion order", failures);
+
+        const AtlasBuilder* others[] = { &backward, &interleaved };
+        for(const AtlasBuilder* other : others) {
+            expect(other->getNumPages() == forward.getNumPages(), name, "the same number of pages", failures);
+            for(size_t p=0; p<forward.getNumPages() && p<other->getNumPages(); ++p)
+                expect(samePixels(forward.getPage(p), other->getPage(p)), name, "the same page sizes and pixels", failures);
+        }
+
+        // every image on its page, inside it and clear of the others by the
+        // padding
+        for(const auto& region : forward.getRegions()) {
+            const sf::IntRect& r = region.second.rect;
+            const sf::Vector2u pageSize = forward.getPage(region.second.page).getSize();
+            expect(r.left >= 0 && r.top >= 0 && r.left + r.width <= int(pageSize.x) && r.top + r.height <= int(pageSize.y),
+                   name, "every region inside its page", failures);
+
+            for(const auto& other : forward.getRegions()) {
+                if(&other == &region || other.second.page != region.second.page)
+                    continue;
+
+                const sf::IntRect& o = other.second.rect;
+                const bool apart = r.left + r.width + int(ATLAS_PADDING) <= o.left || o.left + o.width + int(ATLAS_PADDING) <= r.left ||
+                                   r.top + r.height + int(ATLAS_PADDING) <= o.top || o.top + o.height + int(ATLAS_PADDING) <= r.top;
+                expect(apart, name, "no two regions to overlap", failures);
+            }
+        }
+
+        for(size_t i=0; i<numImages; ++i) {
+            const AtlasBuilder::Region* region = forward.find(names[i]);
+            if(region == nullptr)
+                continue;
+
+            const sf::Image& page = forward.getPage(region->page);
+            expect(page.getPixel(region->rect.left, region->rect.top) == images[i].getPixel(0, 0) &&
+                   page.getPixel(region->rect.left + region->rect.width - 1, region->rect.top + region->rect.height - 1) ==
+                   images[i].getPixel(sizes[i][0] - 1, sizes[i][1] - 1),
+                   name, "every image copied into its region", failures);
+        }
+
+        return failures;
+    }
+}
+
+size_t printChecks(const std::string& resPath)
+{
+    const size_t pool    = checkPool();
+    const size_t batch   = checkBatch();
+    const size_t decoder = checkDecoder(resPath);
+    const size_t atlas   = checkAtlas();
+
+    printf("\"pool\":%zu,\"batch\":%zu,\"decoder\":%zu,\"atlas\":%zu", pool, batch, decoder, atlas);
+
+    return pool + batch + decoder + atlas;
+}
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace bench
+{
+    // CPU side checks of the parts an effect file doesn't exercise, run by
+    // --headless --verify. Prints the failures of each check as JSON members
+    // and every failed expectation to stderr. Files are read from `resPath`.
+    // Returns the failures summed over all checks.
+    size_t printChecks(const std::string& resPath);
+}
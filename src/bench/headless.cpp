@@ -0,0 +1,366 @@
+#include "headless.hpp"
+#include "checks.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+#endif
+
+#include "particlefx.hpp"
+#include "particle_kernel.hpp"
+#include "particle_vertices.hpp"
+#include "particle_batch.hpp"
+#include "particle_binary.hpp"
+#include "jobs.hpp"
+#include "cereal.hpp"
+#include "archives/json.hpp"
+
+namespace bench
+{
+
+namespace
+{
+    struct Options
+    {
+        Options() : frames(600), dt(1.f/60.f), seed(0), count(0), verify(false), resPath("res") {}
+
+        size_t frames;
+        float dt;
+        u32 seed;
+        size_t count;
+        bool verify;
+        std::string resPath;
+        std::vector<std::string> files;
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: Particles --headless [options] effect.pfx...\n"
+                  << "  --frames N    steps to simulate (600)\n"
+                  << "  --dt S        fixed step in seconds (1/60)\n"
+                  << "  --seed N      seed of the first effect, the next ones count up\n"
+                  << "  --count N     override the particle count of every effect\n"
+                  << "  --isa NAME    force the integrator path (scalar, sse2, avx2)\n"
+                  << "  --verify      check every integrator and vertex path against the reference,\n"
+                  << "                and run the CPU side checks, exits with a failure on any mismatch\n"
+                  << "  --res DIR     resources read by the checks (res)\n";
+    }
+
+    bool parseOptions(int argc, char** args, Options& options)
+    {
+        for(int i=0; i<argc; ++i)
+        {
+            const std::string arg = args[i];
+            const bool hasValue = i+1 < argc;
+
+            if(arg == "--frames" && hasValue)
+                options.frames = strtoul(args[++i], nullptr, 10);
+            else if(arg == "--dt" && hasValue)
+                options.dt = strtof(args[++i], nullptr);
+            else if(arg == "--seed" && hasValue)
+                options.seed = strtoul(args[++i], nullptr, 10);
+            else if(arg == "--count" && hasValue)
+                options.count = strtoul(args[++i], nullptr, 10);
+            else if(arg == "--verify")
+                options.verify = true;
+            else if(arg == "--res" && hasValue)
+                options.resPath = args[++i];
+            else if(arg == "--isa" && hasValue) {
+                const std::string name = args[++i];
+                if(name == "scalar")    particle_kernel::setIsa(particle_kernel::ISA_SCALAR);
+                else if(name == "sse2") particle_kernel::setIsa(particle_kernel::ISA_SSE2);
+                else if(name == "avx2") particle_kernel::setIsa(particle_kernel::ISA_AVX2);
+                else return false;
+            }
+            else if(arg.compare(0, 2, "--") == 0)
+                return false;
+            else
+                options.files.push_back(arg);
+        }
+
+        return !options.files.empty() && options.frames > 0 && options.dt > 0;
+    }
+
+    bool loadEffect(const std::string& path, ParticleEmitter& emitter)
+    {
+        std::string imgpath;
+        if(particle_binary::loadFirst(path, emitter, imgpath))
+            return true;
+
+        try {
+            std::ifstream is(path);
+            if(!is)
+                return false;
+
+            cereal::JSONInputArchive archive(is);
+            archive(imgpath);
+            archive(emitter);
+        }
+        catch(const cereal::Exception& e) {
+            std::cerr << "Failed to load " << path << ": " << e.what() << "\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    double toMs(const sf::Time& time)
+    {
+        return time.asMicroseconds() / 1000.0;
+    }
+
+    void copyParticles(const ParticleData& from, ParticleData& to, size_t count)
+    {
+        to.resize(count);
+
+        const float* src[] = { from.posX, from.posY, from.velX, from.velY, from.life, from.lifetime, from.size, from.rotation, (const float*)from.color,
+                               from.frame, from.frameStart };
+        float*       dst[] = { to.posX,   to.posY,   to.velX,   to.velY,   to.life,   to.lifetime,   to.size,   to.rotation,   (float*)to.color,
+                               to.frame,   to.frameStart };
+
+        for(size_t i=0; i<sizeof(src)/sizeof(src[0]); ++i)
+            memcpy(dst[i], src[i], count * sizeof(float));
+    }
+
+    // Particles whose streams differ bitwise from the reference, dead ones
+    // only have to agree on being dead
+    size_t compareParticles(const ParticleData& a, const std::vector<u32>& deadA, size_t numDeadA,
+                            const ParticleData& b, const std::vector<u32>& deadB, size_t numDeadB)
+    {
+        if(numDeadA != numDeadB || memcmp(deadA.data(), deadB.data(), numDeadA*sizeof(u32)) != 0)
+            return a.count;
+
+        size_t mismatches = 0;
+        size_t d = 0;
+        for(size_t i=0; i<a.count; ++i)
+        {
+            if(d < numDeadA && deadA[d] == i) {
+                ++d;
+                continue;
+            }
+
+            if(a.posX[i] != b.posX[i] || a.posY[i] != b.posY[i] ||
+               a.velX[i] != b.velX[i] || a.velY[i] != b.velY[i] ||
+               a.life[i] != b.life[i] || a.rotation[i] != b.rotation[i] ||
+               a.color[i] != b.color[i] || a.frame[i] != b.frame[i])
+                ++mismatches;
+        }
+
+        return mismatches;
+    }
+
+    size_t compareVertices(const std::vector<sf::Vertex>& a, const std::vector<sf::Vertex>& b)
+    {
+        size_t mismatches = 0;
+        for(size_t i=0; i<a.size(); ++i)
+        {
+            if(a[i].position != b[i].position || a[i].color != b[i].color)
+                ++mismatches;
+        }
+        return mismatches;
+    }
+
+    // Run every integrator path and every vertex path on the emitter's
+    // current state and compare them against the scalar reference, returns
+    // the mismatches summed over all paths
+    size_t printVerify(const ParticleEmitter& emitter, float dt)
+    {
+        size_t failures = 0;
+
+        const ParticleData& state = emitter.getParticles();
+        const size_t n = emitter.getAliveCount();
+        const particle_kernel::Params k = emitter.getParams(sf::seconds(dt));
+
+        ParticleData ref, test;
+        std::vector<u32> refDead(n), testDead(n);
+
+        copyParticles(state, ref, n);
+        const size_t refNumDead = particle_kernel::integrateScalar(ref, 0, n, k, refDead.data());
+
+        std::cout << "\"kernels\":[";
+        for(int isa=particle_kernel::ISA_SCALAR; isa<=particle_kernel::detect(); ++isa)
+        {
+            copyParticles(state, test, n);
+
+            sf::Clock clock;
+            size_t numDead = 0;
+            switch(isa)
+            {
+            case particle_kernel::ISA_AVX2: numDead = particle_kernel::integrateAVX2(test, 0, n, k, testDead.data()); break;
+            case particle_kernel::ISA_SSE2: numDead = particle_kernel::integrateSSE2(test, 0, n, k, testDead.data()); break;
+            default:                        numDead = particle_kernel::integrateScalar(test, 0, n, k, testDead.data()); break;
+            }
+            const sf::Time time = clock.getElapsedTime();
+
+            const size_t mismatches = compareParticles(ref, refDead, refNumDead, test, testDead, numDead);
+            failures += mismatches;
+
+            printf("%s{\"isa\":\"%s\",\"ms\":%.3f,\"mismatches\":%zu}", isa > 0 ? "," : "",
+                   particle_kernel::getIsaName((particle_kernel::Isa)isa), toMs(time), mismatches);
+        }
+        std::cout << "],";
+
+        std::vector<sf::Vertex> reference(n*4), rotated(n*4), aligned(n*4), expanded(n*4), points(n);
+        sf::Clock clock;
+
+        particle_vertices::buildReference(state, 0, n, reference.data());
+        const sf::Time referenceTime = clock.restart();
+
+        particle_vertices::buildRotated(state, 0, n, rotated.data());
+        const sf::Time rotatedTime = clock.restart();
+
+        particle_vertices::buildAxisAligned(state, 0, n, aligned.data());
+        const sf::Time alignedTime = clock.restart();
+
+        particle_vertices::buildPoints(state, 0, n, points.data());
+        const sf::Time pointsTime = clock.restart();
+
+        particle_vertices::expandPoints(points.data(), 0, n, expanded.data());
+
+        const size_t rotatedMismatches = compareVertices(reference, rotated);
+        const size_t pointsMismatches  = compareVertices(reference, expanded);
+        failures += rotatedMismatches + pointsMismatches;
+
+        printf("\"vertices\":{\"reference_ms\":%.3f,\"rotated_ms\":%.3f,\"axis_aligned_ms\":%.3f,\"points_ms\":%.3f,"
+               "\"rotated_mismatches\":%zu,\"points_mismatches\":%zu}",
+               toMs(referenceTime), toMs(rotatedTime), toMs(alignedTime), toMs(pointsTime),
+               rotatedMismatches, pointsMismatches);
+
+        return failures;
+    }
+}
+
+size_t getPeakMemoryKB()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    #if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+    #else
+    return usage.ru_maxrss;
+    #endif
+#else
+    return 0;
+#endif
+}
+
+std::string jsonString(const std::string& str)
+{
+    std::string out = "\"";
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+int runHeadless(int argc, char** args)
+{
+    Options options;
+    if(!parseOptions(argc, args, options)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ParticleEmitter*> emitters;
+    for(size_t i=0; i<options.files.size(); ++i)
+    {
+        ParticleEmitter* emitter = new ParticleEmitter;
+        emitters.push_back(emitter);
+
+        if(!loadEffect(options.files[i], *emitter)) {
+            for(auto e : emitters)
+                delete e;
+            return EXIT_FAILURE;
+        }
+
+        emitter->seed = options.seed + i;
+        emitter->resize(options.count > 0 ? options.count : emitter->count);
+        emitter->resetAll();
+    }
+
+    const sf::Time dt = sf::seconds(options.dt);
+    sf::Clock clock;
+
+    // emitters are stepped one after the other so the phase timings of
+    // each one are not skewed by the others
+    for(size_t f=0; f<options.frames; ++f)
+    {
+        for(auto emitter : emitters)
+            emitter->update(dt);
+    }
+
+    const sf::Time total = clock.getElapsedTime();
+
+    // what the app would submit for the final frame, without a GPU
+    ParticleBatch batch;
+    for(auto emitter : emitters)
+        batch.add(*emitter);
+    clock.restart();
+    batch.build();
+    const sf::Time batchTime = clock.getElapsedTime();
+
+    printf("{\"frames\":%zu,\"dt\":%g,\"isa\":\"%s\",\"workers\":%zu,\"effects\":[",
+           options.frames, options.dt, particle_kernel::getIsaName(particle_kernel::getIsa()),
+           JobSystem::get().getNumWorkers());
+
+    size_t particles = 0;
+    size_t failures = 0;
+    for(size_t i=0; i<emitters.size(); ++i)
+    {
+        const EmitterStats& stats = emitters[i]->getStats();
+        const sf::Time busy = stats.integrate + stats.respawn + stats.vertices;
+        particles += stats.particles;
+
+        printf("%s{\"file\":%s,\"count\":%zu,\"alive\":%zu,\"spawned\":%zu,"
+               "\"integrate_ms\":%.3f,\"respawn_ms\":%.3f,\"vertices_ms\":%.3f,\"particles_per_sec\":%.0f",
+               i > 0 ? "," : "", jsonString(options.files[i]).c_str(),
+               emitters[i]->getCount(), emitters[i]->getAliveCount(), stats.spawned,
+               toMs(stats.integrate), toMs(stats.respawn), toMs(stats.vertices),
+               busy.asMicroseconds() > 0 ? stats.particles / (busy.asMicroseconds() / 1e6) : 0.0);
+
+        if(options.verify) {
+            std::cout << ",\"verify\":{";
+            failures += printVerify(*emitters[i], options.dt);
+            std::cout << "}";
+        }
+
+        std::cout << "}";
+    }
+
+    printf("],\"batch\":{\"draws\":%zu,\"vertices\":%zu,\"build_ms\":%.3f}",
+           batch.getGroups().size(), batch.getVertexCount(), toMs(batchTime));
+
+    if(options.verify) {
+        std::cout << ",\"checks\":{";
+        failures += printChecks(options.resPath);
+        std::cout << "}";
+    }
+
+    printf(",\"total_ms\":%.3f,\"particles_per_sec\":%.0f,\"peak_memory_kb\":%zu}\n",
+           toMs(total), total.asMicroseconds() > 0 ? particles / (total.asMicroseconds() / 1e6) : 0.0,
+           getPeakMemoryKB());
+
+    for(auto emitter : emitters)
+        delete emitter;
+
+    // --verify is a regression gate, any path off the reference or failed
+    // check fails it
+    if(failures > 0) {
+        std::cerr << "Verify failed: " << failures << " mismatches and failed checks\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+namespace bench
+{
+    // Windowless simulation runner, see runHeadless() for the options.
+    // Prints a JSON report to stdout and returns the process exit code.
+    int runHeadless(int argc, char** args);
+
+    // Peak resident memory of this process in KiB, 0 when unknown
+    size_t getPeakMemoryKB();
+
+    // Quote and escape a string for the JSON reports
+    std::string jsonString(const std::string& str);
+}
@@ -20,3 +20,16 @@
 #define PROC_FIXED      1
 #define PROC_PRE_DRAW   1
 #define PROC_POST_DRAW  1
+
+// Job system worker threads, 0 = one per extra hardware thread
+#define JOB_WORKERS     0
+
+// Threads decoding images in the background, and the decoded images turned
+// into textures per frame at most
+#define IO_THREADS      1
+#define TEXTURE_UPLOADS 2
+
+// Transient memory reset at the start of every frame, and the share each
+// thread carves out of it at once
+#define FRAME_MEMORY    (8 << 20)
+#define FRAME_BLOCK     (16 << 10)
@@ -1,5 +1,12 @@
 #include "alloc.hpp"
 
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
 /// Allocator (Base)
 Allocator::Allocator(size_t size, void* start)
     //: totalSize(size), startPtr(start), usedMem(0), numAllocs(0)
@@ -40,6 +47,71 @@ size_t Allocator::getNumAllocations() const
 }
 
 
+/// HeapAllocator
+HeapAllocator::HeapAllocator()
+    : Allocator(0, nullptr), used(0), count(0)
+{
+}
+
+HeapAllocator::~HeapAllocator()
+{
+    ASSERT(count == 0);
+}
+
+void* HeapAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size != 0 && alignment != 0);
+
+    //Room for the header and the worst case adjustment
+    void* block = malloc(size + sizeof(AllocationHeader) + alignment);
+
+    if(block == nullptr)
+        return nullptr;
+
+    size_t adjustment = pointer::alignForwardAdjustmentWithHeader(reinterpret_cast<uptr>(block), alignment, sizeof(AllocationHeader));
+
+    void* aligned_address = pointer::add(block, adjustment);
+
+    AllocationHeader* header = (AllocationHeader*)pointer::subtract(aligned_address, sizeof(AllocationHeader));
+    header->size             = size;
+    header->adjustment       = adjustment;
+
+    used.fetch_add(size, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    return aligned_address;
+}
+
+void HeapAllocator::deallocate(void* p)
+{
+    if(p == nullptr)
+        return;
+
+    AllocationHeader* header = (AllocationHeader*)pointer::subtract(p, sizeof(AllocationHeader));
+
+    used.fetch_sub(header->size, std::memory_order_relaxed);
+    count.fetch_sub(1, std::memory_order_relaxed);
+
+    free(pointer::subtract(p, header->adjustment));
+}
+
+size_t HeapAllocator::getUsedMemory() const
+{
+    return used.load(std::memory_order_relaxed);
+}
+
+size_t HeapAllocator::getNumAllocations() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+Allocator& mem::getDefaultAllocator()
+{
+    static HeapAllocator heap;
+    return heap;
+}
+
+
 /// LinearAllocator
 LinearAllocator::LinearAllocator(size_t size, void* start)
     : Allocator(size, start), marker(start)
@@ -52,11 +124,11 @@ LinearAllocator::~LinearAllocator()
     marker   = nullptr;
 }
 
-void* LinearAllocator::allocate(size_t size, u8 alignment)
+void* LinearAllocator::allocate(size_t size, size_t alignment)
 {
     ASSERT(size != 0);
 
-    u8 adjustment =  pointer::alignForwardAdjustment(marker, alignment);
+    size_t adjustment =  pointer::alignForwardAdjustment(marker, alignment);
 
     if(usedMem + adjustment + size > allocSize)
         return nullptr;
@@ -105,11 +177,11 @@ StackAllocator::~StackAllocator()
     marker          = nullptr;
 }
 
-void* StackAllocator::allocate(size_t size, u8 alignment)
+void* StackAllocator::allocate(size_t size, size_t alignment)
 {
     ASSERT(size != 0);
 
-    u8 adjustment = pointer::alignForwardAdjustmentWithHeader(marker, alignment, sizeof(AllocationHeader));
+    size_t adjustment = pointer::alignForwardAdjustmentWithHeader(marker, alignment, sizeof(AllocationHeader));
 
     if(usedMem + adjustment + size > allocSize)
         return nullptr;
@@ -169,7 +241,7 @@ FreeListAllocator::~FreeListAllocator()
     free_blocks        = nullptr;
 }
 
-void* FreeListAllocator::allocate(size_t size, u8 alignment)
+void* FreeListAllocator::allocate(size_t size, size_t alignment)
 {
     ASSERT(size != 0 && alignment != 0);
 
@@ -179,7 +251,7 @@ void* FreeListAllocator::allocate(size_t size, u8 alignment)
     while(free_block != nullptr)
     {
         //Calculate adjustment needed to keep object correctly aligned
-        u8 adjustment = pointer::alignForwardAdjustmentWithHeader(free_block, alignment, sizeof(AllocationHeader));
+        size_t adjustment = pointer::alignForwardAdjustmentWithHeader(free_block, alignment, sizeof(AllocationHeader));
 
         size_t total_size = size + adjustment;
 
@@ -288,15 +360,331 @@ void FreeListAllocator::deallocate(void* p)
     usedMem -= block_size;
 }
 
+float FreeListAllocator::getFragmentation() const
+{
+    size_t total   = 0;
+    size_t largest = 0;
+
+    for(FreeBlock* free_block = free_blocks; free_block != nullptr; free_block = free_block->next)
+    {
+        total += free_block->size;
+
+        if(free_block->size > largest)
+            largest = free_block->size;
+    }
+
+    return total > 0 ? 1.0f - (float)largest / total : 0.0f;
+}
+
+
+/// TLSFAllocator
+namespace
+{
+    // Index of the lowest set bit, x must not be 0
+    inline size_t findFirstSet(u64 x)
+    {
+        #if defined(__GNUC__)
+        return __builtin_ctzll(x);
+        #else
+        size_t i = 0;
+        while(!(x & 1)) { x >>= 1; ++i; }
+        return i;
+        #endif
+    }
+
+    // Index of the highest set bit, x must not be 0
+    inline size_t findLastSet(size_t x)
+    {
+        #if defined(__GNUC__)
+        return sizeof(unsigned long long)*8 - 1 - __builtin_clzll(x);
+        #else
+        size_t i = 0;
+        while(x >>= 1) ++i;
+        return i;
+        #endif
+    }
+}
+
+TLSFAllocator::TLSFAllocator(size_t size, void* start)
+    : Allocator(size, start), flBitmap(0)
+{
+    for(size_t i = 0; i < FL_INDEX_COUNT; i++)
+    {
+        slBitmap[i] = 0;
+
+        for(size_t j = 0; j < SL_INDEX_COUNT; j++)
+            freeBlocks[i][j] = nullptr;
+    }
+
+    size_t adjustment = pointer::alignForwardAdjustment(start, ALIGN_SIZE);
+
+    ASSERT(size > adjustment + 2*BLOCK_OVERHEAD + MIN_BLOCK_SIZE);
+
+    //One free block spanning the memory, followed by a used zero sized block
+    //so the last real block always has a next neighbour to check
+    size_t available = (size - adjustment - 2*BLOCK_OVERHEAD) & ~(ALIGN_SIZE-1);
+
+    ASSERT(available < MAX_BLOCK_SIZE);
+
+    BlockHeader* block = (BlockHeader*)pointer::add(start, adjustment);
+    block->prevPhys    = nullptr;
+    block->size        = available | FREE_BIT;
+
+    BlockHeader* sentinel = nextPhys(block);
+    sentinel->prevPhys    = block;
+    sentinel->size        = 0;
+
+    insertFreeBlock(block);
+}
+
+TLSFAllocator::~TLSFAllocator()
+{
+    flBitmap = 0;
+}
+
+void TLSFAllocator::mapping(size_t size, size_t& fl, size_t& sl)
+{
+    if(size < SMALL_BLOCK_SIZE)
+    {
+        //Small sizes are split linearly into ALIGN_SIZE steps
+        fl = 0;
+        sl = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    }
+    else
+    {
+        //The top bit picks the first level, the next bits the second
+        size_t last = findLastSet(size);
+        sl = (size >> (last - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        fl = last - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+void TLSFAllocator::insertFreeBlock(BlockHeader* block)
+{
+    size_t fl, sl;
+    mapping(blockSize(block), fl, sl);
+
+    BlockHeader* head = freeBlocks[fl][sl];
+
+    block->nextFree = head;
+    block->prevFree = nullptr;
+
+    if(head != nullptr)
+        head->prevFree = block;
+
+    freeBlocks[fl][sl] = block;
+
+    flBitmap     |= 1u << fl;
+    slBitmap[fl] |= 1u << sl;
+}
+
+void TLSFAllocator::removeFreeBlock(BlockHeader* block)
+{
+    size_t fl, sl;
+    mapping(blockSize(block), fl, sl);
+
+    if(block->prevFree != nullptr)
+        block->prevFree->nextFree = block->nextFree;
+    else
+        freeBlocks[fl][sl] = block->nextFree;
+
+    if(block->nextFree != nullptr)
+        block->nextFree->prevFree = block->prevFree;
+
+    //Clear the bitmaps once the bin is empty
+    if(freeBlocks[fl][sl] == nullptr)
+    {
+        slBitmap[fl] &= ~(1u << sl);
+
+        if(slBitmap[fl] == 0)
+            flBitmap &= ~(1u << fl);
+    }
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::findFreeBlock(size_t size)
+{
+    //Round the request up to the next bin boundary, so any block in the
+    //bin found is large enough and the first one can be taken
+    if(size >= SMALL_BLOCK_SIZE)
+        size += (size_t(1) << (findLastSet(size) - SL_INDEX_COUNT_LOG2)) - 1;
+
+    size_t fl, sl;
+    mapping(size, fl, sl);
+
+    if(fl >= FL_INDEX_COUNT)
+        return nullptr;
+
+    //Same first level, same or larger second level
+    u32 slMap = slBitmap[fl] & (~0u << sl);
+
+    if(slMap == 0)
+    {
+        //Else the smallest non empty larger first level
+        u32 flMap = fl+1 < 32 ? flBitmap & (~0u << (fl+1)) : 0;
+
+        if(flMap == 0)
+            return nullptr;
+
+        fl    = findFirstSet(flMap);
+        slMap = slBitmap[fl];
+    }
+
+    sl = findFirstSet(slMap);
+
+    BlockHeader* block = freeBlocks[fl][sl];
+
+    removeFreeBlock(block);
+
+    return block;
+}
+
+TLSFAllocator::BlockHeader* TLSFAllocator::split(BlockHeader* block, size_t size)
+{
+    BlockHeader* remaining = (BlockHeader*)pointer::add(block, BLOCK_OVERHEAD + size);
+    remaining->prevPhys    = block;
+    remaining->size        = (blockSize(block) - size - BLOCK_OVERHEAD) | FREE_BIT;
+
+    nextPhys(remaining)->prevPhys = remaining;
+
+    block->size = size | (block->size & FREE_BIT);
+
+    return remaining;
+}
+
+void TLSFAllocator::merge(BlockHeader* block)
+{
+    BlockHeader* next = nextPhys(block);
+
+    block->size += BLOCK_OVERHEAD + blockSize(next);
+
+    nextPhys(block)->prevPhys = block;
+}
+
+void* TLSFAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size != 0 && alignment != 0);
+
+    //Round up to keep every block header aligned
+    size = (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE-1);
+
+    if(size < MIN_BLOCK_SIZE)
+        size = MIN_BLOCK_SIZE;
+
+    //Payloads are already ALIGN_SIZE aligned, larger alignments need room
+    //to cut a free block off the front
+    size_t gap = alignment > ALIGN_SIZE ? alignment + BLOCK_OVERHEAD + MIN_BLOCK_SIZE : 0;
+
+    if(size + gap >= MAX_BLOCK_SIZE)
+        return nullptr;
+
+    BlockHeader* block = findFreeBlock(size + gap);
+
+    if(block == nullptr)
+        return nullptr;
+
+    if(gap > 0)
+    {
+        void*  payload    = toPayload(block);
+        size_t adjustment = pointer::alignForwardAdjustment(payload, alignment);
+
+        //The leading gap has to be able to hold a free block of its own
+        if(adjustment > 0 && adjustment < BLOCK_OVERHEAD + MIN_BLOCK_SIZE)
+        {
+            void* minimum = pointer::add(payload, BLOCK_OVERHEAD + MIN_BLOCK_SIZE);
+            adjustment = (uptr)pointer::alignForward(minimum, alignment) - (uptr)payload;
+        }
+
+        if(adjustment > 0)
+        {
+            BlockHeader* aligned = split(block, adjustment - BLOCK_OVERHEAD);
+            insertFreeBlock(block);
+            block = aligned;
+        }
+    }
+
+    //Give back what is left when it can make a block on its own
+    if(blockSize(block) >= size + BLOCK_OVERHEAD + MIN_BLOCK_SIZE)
+        insertFreeBlock(split(block, size));
+
+    block->size &= ~FREE_BIT;
+
+    usedMem += blockSize(block) + BLOCK_OVERHEAD;
+    numAllocs++;
+
+    ASSERT(pointer::alignForwardAdjustment(toPayload(block), alignment) == 0);
+
+    return toPayload(block);
+}
+
+void TLSFAllocator::deallocate(void* p)
+{
+    ASSERT(p != nullptr);
+
+    BlockHeader* block = toBlock(p);
+
+    ASSERT(!isFree(block));
+
+    usedMem -= blockSize(block) + BLOCK_OVERHEAD;
+    numAllocs--;
+
+    block->size |= FREE_BIT;
+
+    //Coalesce with free neighbours, found in O(1) through the boundary tags
+    BlockHeader* next = nextPhys(block);
+
+    if(isFree(next))
+    {
+        removeFreeBlock(next);
+        merge(block);
+    }
+
+    BlockHeader* prev = block->prevPhys;
+
+    if(prev != nullptr && isFree(prev))
+    {
+        removeFreeBlock(prev);
+        merge(prev);
+        block = prev;
+    }
+
+    insertFreeBlock(block);
+}
+
+float TLSFAllocator::getFragmentation() const
+{
+    size_t total   = 0;
+    size_t largest = 0;
+
+    for(u32 fl = flBitmap; fl != 0; fl &= fl - 1)
+    {
+        size_t i = findFirstSet(fl);
+
+        for(u32 sl = slBitmap[i]; sl != 0; sl &= sl - 1)
+        {
+            size_t j = findFirstSet(sl);
+
+            for(BlockHeader* block = freeBlocks[i][j]; block != nullptr; block = block->nextFree)
+            {
+                total += blockSize(block);
+
+                if(blockSize(block) > largest)
+                    largest = blockSize(block);
+            }
+        }
+    }
+
+    return total > 0 ? 1.0f - (float)largest / total : 0.0f;
+}
+
 
 /// PoolAllocator
-PoolAllocator::PoolAllocator(size_t objectSize, u8 objectAlignment, size_t size, void* mem)
+PoolAllocator::PoolAllocator(size_t objectSize, size_t objectAlignment, size_t size, void* mem)
     : Allocator(size, mem), objectSize(objectSize), objectAlignment(objectAlignment)
 {
-    ASSERT(objectSize >= sizeof(void*));
+    ASSERT(objectSize >= sizeof(void*) && objectSize % objectAlignment == 0);
 
     //Calculate adjustment needed to keep object correctly aligned
-    u8 adjustment = pointer::alignForwardAdjustment(mem, objectAlignment);
+    size_t adjustment = pointer::alignForwardAdjustment(mem, objectAlignment);
 
     freeList = (void**)pointer::add(mem, adjustment);
 
@@ -319,7 +707,7 @@ PoolAllocator::~PoolAllocator()
     freeList = nullptr;
 }
 
-void* PoolAllocator::allocate(size_t size, u8 alignment)
+void* PoolAllocator::allocate(size_t size, size_t alignment)
 {
     ASSERT(size == objectSize && alignment == objectAlignment);
 
@@ -347,6 +735,493 @@ void PoolAllocator::deallocate(void* p)
 }
 
 
+/// ConcurrentPoolAllocator
+namespace
+{
+    static_assert(ALLOC_MAX_THREADS <= 64, "Thread slots are tracked in a 64 bit mask");
+
+    std::atomic<u64> usedThreadSlots(0);
+
+    // Slot of the calling thread in the thread aware allocators, the same in
+    // all of them. It is handed back when the thread exits, so short lived
+    // threads don't use them up. Threads beyond ALLOC_MAX_THREADS get none.
+    struct ThreadSlot
+    {
+        ThreadSlot() : index(ALLOC_MAX_THREADS)
+        {
+            u64 used = usedThreadSlots.load(std::memory_order_relaxed);
+
+            while(~used != 0)
+            {
+                u32 slot = findFirstSet(~used);
+
+                if(slot >= ALLOC_MAX_THREADS)
+                    break;
+
+                //Acquire what the previous owner left in the slot
+                if(usedThreadSlots.compare_exchange_weak(used, used | (u64(1) << slot), std::memory_order_acquire))
+                {
+                    index = slot;
+                    break;
+                }
+            }
+        }
+
+        ~ThreadSlot()
+        {
+            if(index < ALLOC_MAX_THREADS)
+                usedThreadSlots.fetch_and(~(u64(1) << index), std::memory_order_release);
+        }
+
+        u32 index;
+    };
+
+    thread_local ThreadSlot threadSlot;
+}
+
+ConcurrentPoolAllocator::ConcurrentPoolAllocator(size_t objectSize, size_t objectAlignment, size_t size, void* mem)
+    : Allocator(size, mem), objectSize(objectSize), objectAlignment(objectAlignment), sharedAllocs(0)
+{
+    ASSERT(objectSize >= sizeof(u32) && objectSize % objectAlignment == 0);
+
+    //The batch links go first, then the slots at their alignment
+    size_t adjustment = pointer::alignForwardAdjustment(mem, __alignof(std::atomic<u32>));
+
+    numObjects = (size - adjustment - objectAlignment) / (objectSize + sizeof(std::atomic<u32>));
+
+    ASSERT(numObjects > 0 && numObjects < INVALID_SLOT);
+
+    nextBatch = (std::atomic<u32>*)pointer::add(mem, adjustment);
+    firstSlot = pointer::alignForward(nextBatch + numObjects, objectAlignment);
+
+    //Cut the slots into full batches and push them in reverse so the
+    //first addresses are handed out first
+    head.store(INVALID_SLOT);
+
+    size_t first = (numObjects-1) / BATCH_SIZE * BATCH_SIZE;
+
+    for(size_t batch = first + BATCH_SIZE; batch > 0; batch -= BATCH_SIZE)
+    {
+        size_t begin = batch - BATCH_SIZE;
+        size_t end   = batch < numObjects ? batch : numObjects;
+
+        for(size_t i = begin; i < end; i++)
+        {
+            new (&nextBatch[i]) std::atomic<u32>(INVALID_SLOT);
+            nextInBatch(i) = i+1 < end ? i+1 : INVALID_SLOT;
+        }
+
+        pushBatch(begin);
+    }
+
+    for(u32 i = 0; i < ALLOC_MAX_THREADS; i++)
+    {
+        magazines[i].numAllocs.store(0);
+        magazines[i].count = 0;
+    }
+}
+
+ConcurrentPoolAllocator::~ConcurrentPoolAllocator()
+{
+    ASSERT(getNumAllocations() == 0);
+
+    firstSlot = nullptr;
+    nextBatch = nullptr;
+}
+
+void ConcurrentPoolAllocator::pushBatch(u32 first)
+{
+    u64 oldHead = head.load(std::memory_order_relaxed);
+    u64 newHead;
+
+    do
+    {
+        nextBatch[first].store((u32)oldHead, std::memory_order_relaxed);
+        newHead = ((oldHead >> 32) + 1) << 32 | first;
+    }
+    while(!head.compare_exchange_weak(oldHead, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+u32 ConcurrentPoolAllocator::popBatch()
+{
+    u64 oldHead = head.load(std::memory_order_acquire);
+    u64 newHead;
+
+    do
+    {
+        u32 first = (u32)oldHead;
+
+        if(first == INVALID_SLOT)
+            return INVALID_SLOT;
+
+        //May read a link that is already stale, the counter makes the CAS fail then
+        newHead = ((oldHead >> 32) + 1) << 32 | nextBatch[first].load(std::memory_order_relaxed);
+    }
+    while(!head.compare_exchange_weak(oldHead, newHead, std::memory_order_acquire, std::memory_order_acquire));
+
+    return (u32)oldHead;
+}
+
+void* ConcurrentPoolAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size == objectSize && alignment == objectAlignment);
+
+    if(threadSlot.index >= ALLOC_MAX_THREADS)
+    {
+        //No magazine, take one slot and give the rest of the batch back
+        u32 slot = popBatch();
+
+        if(slot == INVALID_SLOT)
+            return nullptr;
+
+        if(nextInBatch(slot) != INVALID_SLOT)
+            pushBatch(nextInBatch(slot));
+
+        sharedAllocs.fetch_add(1, std::memory_order_relaxed);
+
+        return toPointer(slot);
+    }
+
+    Magazine& magazine = magazines[threadSlot.index];
+
+    if(magazine.count == 0)
+    {
+        //Refill with a whole batch from the shared list
+        for(u32 slot = popBatch(); slot != INVALID_SLOT; slot = nextInBatch(slot))
+            magazine.slots[magazine.count++] = slot;
+
+        if(magazine.count == 0)
+            return nullptr;
+    }
+
+    u32 slot = magazine.slots[--magazine.count];
+
+    magazine.numAllocs.store(magazine.numAllocs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    return toPointer(slot);
+}
+
+void ConcurrentPoolAllocator::deallocate(void* p)
+{
+    ASSERT(p >= firstSlot && toSlot(p) < numObjects);
+
+    u32 slot = toSlot(p);
+
+    if(threadSlot.index >= ALLOC_MAX_THREADS)
+    {
+        nextInBatch(slot) = INVALID_SLOT;
+        pushBatch(slot);
+
+        sharedAllocs.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Magazine& magazine = magazines[threadSlot.index];
+
+    if(magazine.count == 2*BATCH_SIZE)
+    {
+        //Full, chain the older half into a batch for the shared list
+        for(u32 i = 0; i < BATCH_SIZE; i++)
+            nextInBatch(magazine.slots[i]) = i+1 < BATCH_SIZE ? magazine.slots[i+1] : INVALID_SLOT;
+
+        pushBatch(magazine.slots[0]);
+
+        for(u32 i = 0; i < BATCH_SIZE; i++)
+            magazine.slots[i] = magazine.slots[i + BATCH_SIZE];
+
+        magazine.count = BATCH_SIZE;
+    }
+
+    magazine.slots[magazine.count++] = slot;
+
+    magazine.numAllocs.store(magazine.numAllocs.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+void ConcurrentPoolAllocator::flush()
+{
+    if(threadSlot.index >= ALLOC_MAX_THREADS)
+        return;
+
+    Magazine& magazine = magazines[threadSlot.index];
+
+    if(magazine.count == 0)
+        return;
+
+    for(u32 i = 0; i < magazine.count; i++)
+        nextInBatch(magazine.slots[i]) = i+1 < magazine.count ? magazine.slots[i+1] : INVALID_SLOT;
+
+    pushBatch(magazine.slots[0]);
+
+    magazine.count = 0;
+}
+
+size_t ConcurrentPoolAllocator::getNumAllocations() const
+{
+    //Threads may free what others allocated, only the sum is meaningful
+    long long total = sharedAllocs.load(std::memory_order_relaxed);
+
+    for(u32 i = 0; i < ALLOC_MAX_THREADS; i++)
+        total += magazines[i].numAllocs.load(std::memory_order_relaxed);
+
+    return total > 0 ? (size_t)total : 0;
+}
+
+size_t ConcurrentPoolAllocator::getUsedMemory() const
+{
+    return getNumAllocations() * objectSize;
+}
+
+
+/// FrameAllocator
+FrameAllocator::FrameAllocator(size_t size, void* start, size_t blockSize)
+    : Allocator(size, start), blockSize(blockSize), offset(0), epoch(1), sharedAllocs(0)
+{
+    ASSERT(size > 0);
+
+    for(u32 i = 0; i < ALLOC_MAX_THREADS; i++)
+    {
+        blocks[i].epoch.store(0);
+        blocks[i].cursor = 0;
+        blocks[i].end    = 0;
+        blocks[i].numAllocs.store(0);
+    }
+}
+
+FrameAllocator::~FrameAllocator()
+{
+}
+
+void* FrameAllocator::allocateShared(size_t size, size_t alignment)
+{
+    //Reserve the worst case adjustment up front so one fetch_add is enough
+    size_t reserved = size + alignment - 1;
+    size_t first    = offset.fetch_add(reserved, std::memory_order_relaxed);
+
+    if(first + reserved > allocSize)
+        return nullptr;
+
+    return pointer::alignForward(pointer::add(startPtr, first), alignment);
+}
+
+void* FrameAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size != 0 && alignment != 0);
+
+    //Large requests and threads without a slot share the offset
+    if(blockSize == 0 || threadSlot.index >= ALLOC_MAX_THREADS || size + alignment > blockSize / 4)
+    {
+        void* p = allocateShared(size, alignment);
+
+        if(p != nullptr)
+            sharedAllocs.fetch_add(1, std::memory_order_relaxed);
+
+        return p;
+    }
+
+    ThreadBlock& block = blocks[threadSlot.index];
+    u32 current = epoch.load(std::memory_order_relaxed);
+
+    uptr address = (uptr)pointer::alignForward((void*)block.cursor, alignment);
+
+    if(block.epoch.load(std::memory_order_relaxed) != current || address + size > block.end)
+    {
+        //Carve a new sub-block, what was left of the old one is wasted
+        void* carved = allocateShared(blockSize, 1);
+
+        if(carved == nullptr)
+            return nullptr;
+
+        if(block.epoch.load(std::memory_order_relaxed) != current)
+        {
+            block.epoch.store(current, std::memory_order_relaxed);
+            block.numAllocs.store(0, std::memory_order_relaxed);
+        }
+
+        block.cursor = (uptr)carved;
+        block.end    = block.cursor + blockSize;
+
+        address = (uptr)pointer::alignForward((void*)block.cursor, alignment);
+    }
+
+    block.cursor = address + size;
+    block.numAllocs.store(block.numAllocs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    return (void*)address;
+}
+
+void FrameAllocator::deallocate(void* p)
+{
+    ASSERT( false && "Use clear() instead" );
+}
+
+void FrameAllocator::clear()
+{
+    //Sub-blocks notice the new epoch on their next allocation
+    epoch.fetch_add(1, std::memory_order_relaxed);
+    offset.store(0, std::memory_order_relaxed);
+    sharedAllocs.store(0, std::memory_order_relaxed);
+}
+
+size_t FrameAllocator::getUsedMemory() const
+{
+    size_t used = offset.load(std::memory_order_relaxed);
+
+    return used < allocSize ? used : allocSize;
+}
+
+size_t FrameAllocator::getNumAllocations() const
+{
+    u32 current = epoch.load(std::memory_order_relaxed);
+    size_t total = sharedAllocs.load(std::memory_order_relaxed);
+
+    for(u32 i = 0; i < ALLOC_MAX_THREADS; i++)
+    {
+        if(blocks[i].epoch.load(std::memory_order_relaxed) == current)
+            total += blocks[i].numAllocs.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+
+/// VirtualArenaAllocator
+VirtualArenaAllocator::VirtualArenaAllocator(size_t reserveSize, size_t commitSize)
+    : Allocator(roundToPages(reserveSize), reserve(roundToPages(reserveSize))),
+      commitSize(roundToPages(commitSize)), committed(0)
+{
+    ASSERT(reserveSize > 0 && commitSize > 0);
+    ASSERT(startPtr != nullptr);
+
+    //Nothing can be committed when the reservation failed
+    if(startPtr == nullptr)
+        allocSize = 0;
+
+    marker = startPtr;
+}
+
+VirtualArenaAllocator::~VirtualArenaAllocator()
+{
+    if(startPtr != nullptr)
+    {
+        #if defined(_WIN32)
+        VirtualFree(startPtr, 0, MEM_RELEASE);
+        #else
+        munmap(startPtr, allocSize);
+        #endif
+    }
+
+    marker = nullptr;
+}
+
+size_t VirtualArenaAllocator::getPageSize()
+{
+    #if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+    #else
+    return sysconf(_SC_PAGESIZE);
+    #endif
+}
+
+size_t VirtualArenaAllocator::roundToPages(size_t size)
+{
+    size_t page = getPageSize();
+
+    return (size + page - 1) / page * page;
+}
+
+void* VirtualArenaAllocator::reserve(size_t size)
+{
+    #if defined(_WIN32)
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+    #else
+    void* p = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return p != MAP_FAILED ? p : nullptr;
+    #endif
+}
+
+bool VirtualArenaAllocator::commit(size_t size)
+{
+    if(size <= committed)
+        return true;
+
+    if(size > allocSize)
+        return false;
+
+    //Grow in whole steps, but never past the reservation
+    size_t target = (size + commitSize - 1) / commitSize * commitSize;
+
+    if(target > allocSize)
+        target = allocSize;
+
+    void* begin = pointer::add(startPtr, committed);
+
+    #if defined(_WIN32)
+    if(VirtualAlloc(begin, target - committed, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+        return false;
+    #else
+    if(mprotect(begin, target - committed, PROT_READ | PROT_WRITE) != 0)
+        return false;
+    #endif
+
+    committed = target;
+
+    return true;
+}
+
+void* VirtualArenaAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size != 0);
+
+    size_t adjustment = pointer::alignForwardAdjustment(marker, alignment);
+
+    if(!commit(usedMem + adjustment + size))
+        return nullptr;
+
+    u8* aligned_address = (u8*)marker + adjustment;
+
+    marker = (void*)(aligned_address + size);
+
+    usedMem += size + adjustment;
+    numAllocs++;
+
+    return (void*)aligned_address;
+}
+
+void VirtualArenaAllocator::deallocate(void* p)
+{
+    ASSERT(p >= startPtr && p < marker);
+
+    numAllocs--;
+
+    //Nothing is alive anymore, start over but keep the pages
+    if(numAllocs == 0)
+        reset(false);
+}
+
+void VirtualArenaAllocator::reset(bool decommit)
+{
+    numAllocs = 0;
+    usedMem   = 0;
+
+    marker    = startPtr;
+
+    if(!decommit || committed == 0)
+        return;
+
+    #if defined(_WIN32)
+    VirtualFree(startPtr, committed, MEM_DECOMMIT);
+    #else
+    //Mapping fresh inaccessible pages over the range drops the old ones
+    mmap(startPtr, committed, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    #endif
+
+    committed = 0;
+}
+
+
 /// ProxyAllocator
 ProxyAllocator::ProxyAllocator(Allocator& allocator)
     : Allocator(allocator.getSize(), allocator.getStart()), allocator(allocator)
@@ -357,7 +1232,7 @@ ProxyAllocator::~ProxyAllocator()
 {
 }
 
-void* ProxyAllocator::allocate(size_t size, u8 alignment)
+void* ProxyAllocator::allocate(size_t size, size_t alignment)
 {
     ASSERT(size != 0);
     numAllocs++;
@@ -381,3 +1256,155 @@ void ProxyAllocator::deallocate(void* p)
 
     usedMem -= mem - allocator.getUsedMemory();
 }
+
+
+/// TrackingAllocator
+namespace
+{
+    std::vector<TrackingAllocator*>& trackers()
+    {
+        static std::vector<TrackingAllocator*> list;
+        return list;
+    }
+
+    thread_local const char* siteFile = nullptr;
+    thread_local int         siteLine = 0;
+}
+
+const std::vector<TrackingAllocator*>& mem::getTrackers()
+{
+    return trackers();
+}
+
+mem::ScopedCallSite::ScopedCallSite(const char* file, int line)
+    : prevFile(siteFile), prevLine(siteLine)
+{
+    siteFile = file;
+    siteLine = line;
+}
+
+mem::ScopedCallSite::~ScopedCallSite()
+{
+    siteFile = prevFile;
+    siteLine = prevLine;
+}
+
+TrackingAllocator::TrackingAllocator(Allocator& allocator, const std::string& tag)
+    : Allocator(allocator.getSize(), allocator.getStart()), allocator(allocator), tag(tag),
+      peakMem(0), peakAllocs(0), totalAllocs(0)
+{
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        histogram[i] = 0;
+
+    trackers().push_back(this);
+}
+
+TrackingAllocator::~TrackingAllocator()
+{
+    std::vector<TrackingAllocator*>& list = trackers();
+
+    for(size_t i = 0; i < list.size(); i++)
+    {
+        if(list[i] == this)
+        {
+            list.erase(list.begin() + i);
+            break;
+        }
+    }
+}
+
+size_t TrackingAllocator::getBucket(size_t size)
+{
+    //<= 16 B lands in the first bucket, every further power of two in the next
+    if(size <= 16)
+        return 0;
+
+    size_t bucket = findLastSet(size - 1) - 3;
+
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+size_t TrackingAllocator::getBucketSize(size_t bucket)
+{
+    return size_t(16) << bucket;
+}
+
+void* TrackingAllocator::allocate(size_t size, size_t alignment)
+{
+    ASSERT(size != 0);
+
+    size_t mem = allocator.getUsedMemory();
+
+    void* p = allocator.allocate(size, alignment);
+
+    if(p == nullptr)
+        return nullptr;
+
+    usedMem += allocator.getUsedMemory() - mem;
+    numAllocs++;
+    totalAllocs++;
+    histogram[getBucket(size)]++;
+
+    if(usedMem > peakMem)
+        peakMem = usedMem;
+
+    if(numAllocs > peakAllocs)
+        peakAllocs = numAllocs;
+
+    #if ALLOC_TRACK_SITES
+    Record& record = records[p];
+    record.file = siteFile;
+    record.line = siteLine;
+    record.size = size;
+    #endif
+
+    return p;
+}
+
+void TrackingAllocator::deallocate(void* p)
+{
+    numAllocs--;
+
+    size_t mem = allocator.getUsedMemory();
+
+    allocator.deallocate(p);
+
+    usedMem -= mem - allocator.getUsedMemory();
+
+    #if ALLOC_TRACK_SITES
+    records.erase(p);
+    #endif
+}
+
+void TrackingAllocator::resetPeaks()
+{
+    peakMem    = usedMem;
+    peakAllocs = numAllocs;
+}
+
+std::vector<TrackingAllocator::CallSite> TrackingAllocator::getCallSites() const
+{
+    std::vector<CallSite> sites;
+
+    #if ALLOC_TRACK_SITES
+    for(const auto& entry : records)
+    {
+        const Record& record = entry.second;
+
+        size_t i = 0;
+        while(i < sites.size() && (sites[i].file != record.file || sites[i].line != record.line))
+            i++;
+
+        if(i == sites.size())
+        {
+            CallSite site = { record.file, record.line, 0, 0 };
+            sites.push_back(site);
+        }
+
+        sites[i].numAllocs++;
+        sites[i].size += record.size;
+    }
+    #endif
+
+    return sites;
+}
@@ -2,19 +2,36 @@
 
 #include <stdlib.h>
 #include <cstddef>
+#include <atomic>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <unordered_map>
 
 #include "pointer.hpp"
 #include "error.hpp"
 
 #define ALLOC_DEBUG 1
 
+// Threads that get private state in the thread aware allocators
+#define ALLOC_MAX_THREADS 64
+
+// Record the call site of every tracked allocation, debug builds only
+#ifdef DEBUG_FLAG
+    #define ALLOC_TRACK_SITES 1
+#else
+    #define ALLOC_TRACK_SITES 0
+#endif
+
 class Allocator
 {
 public:
     Allocator(size_t size, void* start);
     virtual ~Allocator();
 
-    virtual void* allocate(size_t size, u8 alignment = 4) = 0;
+    virtual void* allocate(size_t size, size_t alignment = 4) = 0;
 
     virtual void deallocate(void* p) = 0;
 
@@ -22,9 +39,13 @@ public:
 
     size_t getSize() const;
 
-    size_t getUsedMemory() const;
+    virtual size_t getUsedMemory() const;
+
+    virtual size_t getNumAllocations() const;
 
-    size_t getNumAllocations() const;
+    // Share of the free memory outside the largest free block, 0 when the
+    // allocator can't fragment
+    virtual float getFragmentation() const { return 0; }
 
 protected:
     void*         startPtr;
@@ -40,14 +61,12 @@ private:
 
 namespace mem
 {
-    template <class T> T* New(Allocator& allocator)
-    {
-        return new (allocator.allocate(sizeof(T), __alignof(T))) T;
-    }
+    // Heap backed allocator for everything that isn't given one
+    Allocator& getDefaultAllocator();
 
-    template <class T> T* New(Allocator& allocator, const T& t)
+    template <class T, class... Args> T* New(Allocator& allocator, Args&&... args)
     {
-        return new (allocator.allocate(sizeof(T), __alignof(T))) T(t);
+        return new (allocator.allocate(sizeof(T), __alignof(T))) T(std::forward<Args>(args)...);
     }
 
     template<class T> void Delete(Allocator& allocator, T& object)
@@ -56,11 +75,19 @@ namespace mem
         allocator.deallocate(&object);
     }
 
+    // Allocation with an alignment fixed at compile time, like 64 for a cache
+    // line, 4096 for a page or 2 MiB for a huge page
+    template<size_t alignment> void* allocateAligned(Allocator& allocator, size_t size)
+    {
+        static_assert(pointer::isPowerOfTwo(alignment), "Alignment must be a power of two");
+        return allocator.allocate(size, alignment);
+    }
+
     template<class T> T* NewArray(Allocator& allocator, size_t length)
     {
         ASSERT(length != 0);
 
-        u8 headerSize = sizeof(size_t)/sizeof(T);
+        size_t headerSize = sizeof(size_t)/sizeof(T);
 
         if(sizeof(size_t)%sizeof(T) > 0)
             headerSize += 1;
@@ -86,15 +113,82 @@ namespace mem
             array[i].~T();
 
         //Calculate how much extra memory was allocated to store the length before the array
-        u8 headerSize = sizeof(size_t)/sizeof(T);
+        size_t headerSize = sizeof(size_t)/sizeof(T);
 
         if(sizeof(size_t)%sizeof(T) > 0)
             headerSize += 1;
 
         allocator.deallocate(array - headerSize);
     }
+
+    // Lets standard containers draw from an Allocator, which has to be able
+    // to free single blocks and must outlive the container
+    template<class T> class StlAllocator
+    {
+    public:
+        typedef T value_type;
+
+        // Moved and swapped containers take the allocator with the memory,
+        // so containers on different allocators never copy element by element
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+
+        StlAllocator(Allocator& allocator = getDefaultAllocator()) : allocator(&allocator) {}
+
+        template<class U> StlAllocator(const StlAllocator<U>& other) : allocator(other.allocator) {}
+
+        T* allocate(size_t n)
+        {
+            void* p = allocator->allocate(n * sizeof(T), __alignof(T));
+
+            if(p == nullptr)
+                throw std::bad_alloc();
+
+            return (T*)p;
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            allocator->deallocate(p);
+        }
+
+        template<class U> bool operator==(const StlAllocator<U>& other) const { return allocator == other.allocator; }
+        template<class U> bool operator!=(const StlAllocator<U>& other) const { return allocator != other.allocator; }
+
+        Allocator* allocator;
+    };
+
+    template<class T> using Vector = std::vector<T, StlAllocator<T> >;
 }
 
+/// HeapAllocator
+// Forwards to malloc with the alignment and accounting of the other
+// allocators. Any thread may use it.
+class HeapAllocator : public Allocator
+{
+public:
+    HeapAllocator();
+    ~HeapAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    void deallocate(void* p) override;
+
+    size_t getUsedMemory() const override;
+
+    size_t getNumAllocations() const override;
+
+private:
+    struct AllocationHeader
+    {
+        size_t size;
+        size_t adjustment;
+    };
+
+    std::atomic<size_t> used;
+    std::atomic<size_t> count;
+};
+
 /// LinearAllocator
 class LinearAllocator : public Allocator
 {
@@ -102,7 +196,7 @@ public:
     LinearAllocator(size_t size, void* start);
     ~LinearAllocator();
 
-    void* allocate(size_t size, u8 alignment) override;
+    void* allocate(size_t size, size_t alignment) override;
 
     void deallocate(void* p) override;
 
@@ -119,7 +213,7 @@ public:
     StackAllocator(size_t size, void* start);
     ~StackAllocator();
 
-    void* allocate(size_t size, u8 alignment) override;
+    void* allocate(size_t size, size_t alignment) override;
 
     void deallocate(void* p) override;
 
@@ -129,7 +223,7 @@ private:
         #if ALLOC_DEBUG
         void* prev_address;
         #endif
-        u8 adjustment;
+        size_t adjustment;
     };
 
     #if ALLOC_DEBUG
@@ -146,15 +240,17 @@ public:
     FreeListAllocator(size_t size, void* start);
     ~FreeListAllocator();
 
-    void* allocate(size_t size, u8 alignment) override;
+    void* allocate(size_t size, size_t alignment) override;
 
     void deallocate(void* p) override;
 
+    float getFragmentation() const override;
+
 private:
     struct AllocationHeader
     {
         size_t size;
-        u8     adjustment;
+        size_t adjustment;
     };
 
     struct FreeBlock
@@ -166,26 +262,264 @@ private:
     FreeBlock* free_blocks;
 };
 
+/// TLSFAllocator
+// Two-level segregated fit: free blocks are binned by size class and found
+// through two bitmaps, so allocate() and deallocate() never walk a list.
+// Neighbours are merged through boundary tags in each block header.
+class TLSFAllocator : public Allocator
+{
+public:
+    TLSFAllocator(size_t size, void* start);
+    ~TLSFAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    void deallocate(void* p) override;
+
+    float getFragmentation() const override;
+
+private:
+    // Second level bins per power of two, as log2
+    static const size_t SL_INDEX_COUNT_LOG2 = 5;
+    static const size_t SL_INDEX_COUNT      = 1 << SL_INDEX_COUNT_LOG2;
+
+    // Block sizes are multiples of this, and so are the payload addresses
+    static const size_t ALIGN_SIZE_LOG2     = 3;
+    static const size_t ALIGN_SIZE          = 1 << ALIGN_SIZE_LOG2;
+
+    // Sizes below SMALL_BLOCK_SIZE share the first level and are binned linearly
+    static const size_t FL_INDEX_SHIFT      = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+    static const size_t FL_INDEX_MAX        = sizeof(size_t) == 8 ? 38 : 30;
+    static const size_t FL_INDEX_COUNT      = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+    static const size_t SMALL_BLOCK_SIZE    = 1 << FL_INDEX_SHIFT;
+
+    struct BlockHeader
+    {
+        BlockHeader* prevPhys;  // boundary tag, the block right before this one
+        size_t       size;      // payload size, the low bit flags a free block
+
+        // Only valid while the block is free, they live in its payload
+        BlockHeader* nextFree;
+        BlockHeader* prevFree;
+    };
+
+    static const size_t BLOCK_OVERHEAD  = offsetof(BlockHeader, nextFree);
+    static const size_t MIN_BLOCK_SIZE  = sizeof(BlockHeader) - BLOCK_OVERHEAD;
+    static const size_t MAX_BLOCK_SIZE  = size_t(1) << FL_INDEX_MAX;
+    static const size_t FREE_BIT        = 1;
+
+    static_assert(FL_INDEX_COUNT <= 32, "First level bitmap is 32 bits");
+    static_assert(MIN_BLOCK_SIZE % ALIGN_SIZE == 0, "Blocks must stay aligned");
+
+    static inline size_t blockSize(const BlockHeader* block) { return block->size & ~FREE_BIT; }
+    static inline bool   isFree(const BlockHeader* block)    { return block->size & FREE_BIT; }
+
+    static inline void*        toPayload(BlockHeader* block) { return pointer::add(block, BLOCK_OVERHEAD); }
+    static inline BlockHeader* toBlock(void* p)              { return (BlockHeader*)pointer::subtract(p, BLOCK_OVERHEAD); }
+
+    static inline BlockHeader* nextPhys(BlockHeader* block)
+    {
+        return (BlockHeader*)pointer::add(block, BLOCK_OVERHEAD + blockSize(block));
+    }
+
+    static void mapping(size_t size, size_t& fl, size_t& sl);
+
+    void insertFreeBlock(BlockHeader* block);
+    void removeFreeBlock(BlockHeader* block);
+
+    // Remove and return a free block of at least `size` bytes, or nullptr
+    BlockHeader* findFreeBlock(size_t size);
+
+    // Cut `block` after `size` payload bytes and return the free remainder
+    BlockHeader* split(BlockHeader* block, size_t size);
+
+    // Absorb the block following `block`, which must be free and unlisted
+    void merge(BlockHeader* block);
+
+    u32          flBitmap;
+    u32          slBitmap[FL_INDEX_COUNT];
+    BlockHeader* freeBlocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+};
 
 /// PoolAllocator
 class PoolAllocator : public Allocator
 {
 public:
-    PoolAllocator(size_t objectSize, u8 objectAlignment, size_t size, void* mem);
+    PoolAllocator(size_t objectSize, size_t objectAlignment, size_t size, void* mem);
     ~PoolAllocator();
 
-    void* allocate(size_t size, u8 alignment) override;
+    void* allocate(size_t size, size_t alignment) override;
 
     void deallocate(void* p) override;
 
 private:
     size_t     objectSize;
-    u8         objectAlignment;
+    size_t     objectAlignment;
 
     void**     freeList;
 };
 
 
+/// ConcurrentPoolAllocator
+// PoolAllocator that any thread may allocate from and free to. Each thread
+// works from its own magazine of free slots and only touches the shared
+// lock-free list to swap whole batches of slots in or out.
+class ConcurrentPoolAllocator : public Allocator
+{
+public:
+    ConcurrentPoolAllocator(size_t objectSize, size_t objectAlignment, size_t size, void* mem);
+    ~ConcurrentPoolAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    void deallocate(void* p) override;
+
+    // Hand the calling thread's cached slots back, e.g. before it exits
+    void flush();
+
+    size_t getUsedMemory() const override;
+
+    size_t getNumAllocations() const override;
+
+    inline size_t getNumObjects() const { return numObjects; }
+
+private:
+    // Slots moved between a magazine and the shared list at once
+    static const u32 BATCH_SIZE     = 16;
+
+    static const u32 INVALID_SLOT   = 0xFFFFFFFF;
+
+    struct Magazine
+    {
+        // Only the owning thread writes it, others read it for the totals
+        std::atomic<long long> numAllocs;
+
+        u32 count;
+        u32 slots[2*BATCH_SIZE];
+    };
+
+    inline void* toPointer(u32 slot) const { return pointer::add(firstSlot, (size_t)slot * objectSize); }
+    inline u32   toSlot(void* p) const     { return (u32)(((uptr)p - (uptr)firstSlot) / objectSize); }
+
+    // Batches are chained through the first word of their slots
+    inline u32& nextInBatch(u32 slot) const { return *(u32*)toPointer(slot); }
+
+    // Push a chain of slots starting at `first` as one batch
+    void pushBatch(u32 first);
+
+    // Pop a whole batch and return its first slot, INVALID_SLOT when empty
+    u32 popBatch();
+
+    size_t      objectSize;
+    size_t      objectAlignment;
+    size_t      numObjects;
+
+    void*       firstSlot;
+
+    // Next batch after each batch head, kept outside the slots so a stale
+    // read during a lost race never touches memory handed out to a user
+    std::atomic<u32>*   nextBatch;
+
+    // Head slot in the low half, a counter against ABA in the high half
+    std::atomic<u64>    head;
+
+    // Accounting of threads without a magazine
+    std::atomic<long long> sharedAllocs;
+
+    Magazine    magazines[ALLOC_MAX_THREADS];
+};
+
+
+/// FrameAllocator
+// LinearAllocator that any number of threads may bump at once, for memory
+// that only lives until the end of the frame. Threads can carve private
+// sub-blocks so most allocations skip the shared atomic entirely.
+class FrameAllocator : public Allocator
+{
+public:
+    // blockSize is the per-thread carve-out, 0 bumps the shared offset every time
+    FrameAllocator(size_t size, void* start, size_t blockSize = 0);
+    ~FrameAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    void deallocate(void* p) override;
+
+    // Free everything at once, no thread may be allocating meanwhile
+    void clear();
+
+    size_t getUsedMemory() const override;
+
+    size_t getNumAllocations() const override;
+
+    inline u32 getEpoch() const { return epoch.load(std::memory_order_relaxed); }
+
+private:
+    // Bump the shared offset, wait-free
+    void* allocateShared(size_t size, size_t alignment);
+
+    // One cache line each, the owners write theirs on every allocation
+    struct alignas(64) ThreadBlock
+    {
+        // Sub-blocks of older epochs are stale and silently dropped
+        std::atomic<u32> epoch;
+
+        uptr cursor;
+        uptr end;
+
+        std::atomic<size_t> numAllocs;
+    };
+
+    size_t              blockSize;
+
+    std::atomic<size_t> offset;
+    std::atomic<u32>    epoch;
+
+    // Accounting of allocations that bypass the sub-blocks
+    std::atomic<size_t> sharedAllocs;
+
+    ThreadBlock         blocks[ALLOC_MAX_THREADS];
+};
+
+/// VirtualArenaAllocator
+// LinearAllocator over a reserved range of address space. Pages are only
+// committed once the marker reaches them, so the range can be reserved far
+// larger than what is ever used without taking any memory up front.
+class VirtualArenaAllocator : public Allocator
+{
+public:
+    // Both sizes are rounded up to whole pages, commitSize is the growth step
+    VirtualArenaAllocator(size_t reserveSize, size_t commitSize = 64 << 10);
+    ~VirtualArenaAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    // Only accounted, the memory is reused once every allocation is freed
+    void deallocate(void* p) override;
+
+    // Free everything at once, optionally giving the pages back to the OS
+    void reset(bool decommit = true);
+
+    inline size_t getCommittedSize() const { return committed; }
+
+    inline size_t getReservedSize() const { return allocSize; }
+
+    static size_t getPageSize();
+
+private:
+    static size_t roundToPages(size_t size);
+
+    static void* reserve(size_t size);
+
+    // Make sure the first `size` bytes are backed by memory
+    bool commit(size_t size);
+
+    size_t commitSize;
+    size_t committed;
+
+    void*  marker;
+};
+
 /// ProxyAllocator
 class ProxyAllocator : public Allocator
 {
@@ -193,10 +527,107 @@ public:
     ProxyAllocator(Allocator& allocator);
     ~ProxyAllocator();
 
-    void* allocate(size_t size, u8 alignment) override;
+    void* allocate(size_t size, size_t alignment) override;
 
     void deallocate(void* p) override;
 
 private:
     Allocator& allocator;
 };
+
+
+/// TrackingAllocator
+// ProxyAllocator that keeps statistics under a tag, e.g. one emitter or one
+// subsystem. Every tracker is listed by mem::getTrackers() while it lives.
+// Like the proxy it measures the wrapped allocator's usage before and after
+// each call, so it must not share that allocator with other threads.
+class TrackingAllocator : public Allocator
+{
+public:
+    // Power of two size classes from <= 16 B up to > 256 KiB
+    static const size_t HISTOGRAM_BUCKETS = 16;
+
+    struct CallSite
+    {
+        const char* file;
+        int         line;
+        size_t      numAllocs;  // live allocations made there
+        size_t      size;       // bytes requested by them
+    };
+
+    TrackingAllocator(Allocator& allocator, const std::string& tag);
+    ~TrackingAllocator();
+
+    void* allocate(size_t size, size_t alignment) override;
+
+    void deallocate(void* p) override;
+
+    float getFragmentation() const override { return allocator.getFragmentation(); }
+
+    inline const std::string& getTag() const { return tag; }
+
+    inline Allocator& getAllocator() const { return allocator; }
+
+    inline size_t getPeakMemory() const { return peakMem; }
+
+    inline size_t getPeakAllocations() const { return peakAllocs; }
+
+    inline size_t getTotalAllocations() const { return totalAllocs; }
+
+    // Allocations made so far per size class, see getBucket()
+    inline const size_t* getHistogram() const { return histogram; }
+
+    static size_t getBucket(size_t size);
+
+    // Largest size counted in a bucket, the last one is open ended
+    static size_t getBucketSize(size_t bucket);
+
+    // Start the high-water marks over from the current usage
+    void resetPeaks();
+
+    // Live allocations grouped by call site, empty without ALLOC_TRACK_SITES
+    std::vector<CallSite> getCallSites() const;
+
+private:
+    Allocator&  allocator;
+    std::string tag;
+
+    size_t      peakMem;
+    size_t      peakAllocs;
+    size_t      totalAllocs;
+    size_t      histogram[HISTOGRAM_BUCKETS];
+
+    #if ALLOC_TRACK_SITES
+    struct Record
+    {
+        const char* file;
+        int         line;
+        size_t      size;
+    };
+
+    std::unordered_map<void*, Record> records;
+    #endif
+};
+
+namespace mem
+{
+    // Every TrackingAllocator alive, in creation order
+    const std::vector<TrackingAllocator*>& getTrackers();
+
+    // Attributes the tracked allocations of the calling thread to a file and
+    // line until the end of the scope, see ALLOC_SITE()
+    struct ScopedCallSite
+    {
+        ScopedCallSite(const char* file, int line);
+        ~ScopedCallSite();
+
+        const char* prevFile;
+        int         prevLine;
+    };
+}
+
+#if ALLOC_TRACK_SITES
+    #define ALLOC_SITE() mem::ScopedCallSite allocSite(__FILE__, __LINE__)
+#else
+    #define ALLOC_SITE()
+#endif
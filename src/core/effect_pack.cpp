@@ -0,0 +1,238 @@
+#include "effect_pack.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include "particlefx.hpp"
+
+namespace effect_pack
+{
+
+namespace
+{
+    bool lessByName(const Source& a, const Source& b)
+    {
+        return a.name < b.name;
+    }
+
+    // Offset of `s` in the table, adding it the first time
+    u32 addString(std::string& strings, std::map<std::string, u32>& offsets, const std::string& s)
+    {
+        auto it = offsets.find(s);
+        if(it != offsets.end())
+            return it->second;
+
+        const u32 offset = strings.size();
+        strings.append(s.c_str(), s.size() + 1);
+        offsets[s] = offset;
+        return offset;
+    }
+
+    inline u64 alignData(u64 offset)
+    {
+        return (offset + DATA_ALIGNMENT - 1) & ~u64(DATA_ALIGNMENT - 1);
+    }
+}
+
+bool write(const std::string& path, std::vector<Source> sources)
+{
+    std::sort(sources.begin(), sources.end(), lessByName);
+    for(size_t i=1; i<sources.size(); ++i) {
+        if(sources[i].name == sources[i-1].name)
+            return false;
+    }
+
+    std::string strings;
+    std::map<std::string, u32> offsets;
+    std::vector<Entry> entries(sources.size());
+
+    for(size_t i=0; i<sources.size(); ++i) {
+        entries[i].name = addString(strings, offsets, sources[i].name);
+        entries[i].type = sources[i].type;
+
+        if(sources[i].type == TYPE_EFFECT) {
+            sources[i].effect.name  = entries[i].name;
+            sources[i].effect.image = addString(strings, offsets, sources[i].image);
+        }
+    }
+
+    const u64 indexOffset   = sizeof(Header);
+    const u64 stringsOffset = indexOffset + entries.size() * sizeof(Entry);
+
+    u64 end = stringsOffset + strings.size();
+    for(size_t i=0; i<sources.size(); ++i) {
+        entries[i].offset = alignData(end);
+        entries[i].size   = sources[i].type == TYPE_EFFECT ? sizeof(particle_binary::Effect) : sources[i].data.size();
+        end = entries[i].offset + entries[i].size;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic         = MAGIC;
+    header.version       = VERSION;
+    header.endianTag     = particle_binary::ENDIAN_TAG;
+    header.headerSize    = sizeof(Header);
+    header.entrySize     = sizeof(Entry);
+    header.numEntries    = entries.size();
+    header.indexOffset   = indexOffset;
+    header.stringsOffset = stringsOffset;
+    header.stringsSize   = strings.size();
+
+    std::ofstream os(path, std::ios::binary);
+    os.write((const char*)&header, sizeof(header));
+    os.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+    os.write(strings.data(), strings.size());
+
+    const char padding[DATA_ALIGNMENT] = {};
+    u64 written = stringsOffset + strings.size();
+    for(size_t i=0; i<sources.size(); ++i) {
+        os.write(padding, entries[i].offset - written);
+
+        if(sources[i].type == TYPE_EFFECT)
+            os.write((const char*)&sources[i].effect, sizeof(particle_binary::Effect));
+        else
+            os.write(sources[i].data.data(), sources[i].data.size());
+
+        written = entries[i].offset + entries[i].size;
+    }
+
+    return bool(os);
+}
+
+}
+
+using namespace effect_pack;
+
+/// EffectPack
+EffectPack::EffectPack()
+    : header(nullptr), entries(nullptr), strings(nullptr), base(nullptr), size(0)
+{
+}
+
+EffectPack::~EffectPack()
+{
+    close();
+}
+
+bool EffectPack::open(const std::string& path)
+{
+    close();
+
+    if(!mapping.open(path))
+        return false;
+
+    if(!load(mapping.getData(), mapping.getSize())) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool EffectPack::load(const void* data, size_t size)
+{
+    reset();
+
+    const Header* h = (const Header*)data;
+
+    if(size < sizeof(Header) || pointer::alignForwardAdjustment(data, __alignof(Entry)) != 0)
+        return false;
+
+    if(h->magic != MAGIC || h->version != VERSION || h->endianTag != particle_binary::ENDIAN_TAG ||
+       h->headerSize != sizeof(Header) || h->entrySize != sizeof(Entry))
+        return false;
+
+    const u64 indexEnd   = u64(h->indexOffset) + u64(h->numEntries) * sizeof(Entry);
+    const u64 stringsEnd = u64(h->stringsOffset) + h->stringsSize;
+
+    if(h->indexOffset < sizeof(Header) || h->indexOffset % __alignof(Entry) != 0 ||
+       indexEnd > size || stringsEnd > size)
+        return false;
+
+    // with a terminated table every string offset below stringsSize is safe,
+    // the entries themselves are checked as they are reached
+    const char* s = (const char*)data + h->stringsOffset;
+    if(h->stringsSize > 0 && s[h->stringsSize - 1] != '\0')
+        return false;
+
+    header  = h;
+    entries = (const Entry*)pointer::add(data, h->indexOffset);
+    strings = s;
+    base    = data;
+    this->size = size;
+    return true;
+}
+
+void EffectPack::close()
+{
+    reset();
+    mapping.close();
+}
+
+void EffectPack::reset()
+{
+    header  = nullptr;
+    entries = nullptr;
+    strings = nullptr;
+    base    = nullptr;
+    size    = 0;
+}
+
+const Entry* EffectPack::getEntry(size_t index) const
+{
+    if(index >= getNumEntries())
+        return nullptr;
+
+    const Entry& e = entries[index];
+    if(e.name >= header->stringsSize || e.type >= NUM_TYPES || e.offset > size || e.size > size - e.offset)
+        return nullptr;
+
+    if(e.type == TYPE_EFFECT) {
+        if(e.size != sizeof(particle_binary::Effect) || e.offset % __alignof(particle_binary::Effect) != 0)
+            return nullptr;
+
+        const particle_binary::Effect& effect = *(const particle_binary::Effect*)getData(e);
+        if(effect.image >= header->stringsSize)
+            return nullptr;
+    }
+
+    return &e;
+}
+
+const Entry* EffectPack::find(const std::string& name) const
+{
+    size_t first = 0;
+    size_t last  = getNumEntries();
+
+    // entries are sorted by name, an unreadable one is treated as coming
+    // before `name`
+    while(first < last) {
+        const size_t middle = first + (last - first) / 2;
+        const Entry* e = getEntry(middle);
+
+        const int order = e ? strcmp(getName(*e), name.c_str()) : -1;
+        if(order == 0)
+            return e;
+
+        if(order < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return nullptr;
+}
+
+bool EffectPack::loadEffect(const std::string& name, ParticleEmitter& emitter, std::string& image) const
+{
+    const Entry* e = find(name);
+    if(e == nullptr || e->type != TYPE_EFFECT)
+        return false;
+
+    const particle_binary::Effect& effect = *(const particle_binary::Effect*)getData(*e);
+    particle_binary::apply(effect, emitter);
+    image = strings + effect.image;
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pointer.hpp"
+#include "mapped_file.hpp"
+#include "particle_binary.hpp"
+
+// Bundles of effects and the files they use, all little endian: a Header, an
+// index of Entry records sorted by name, a table of null terminated strings,
+// then the payloads. Effects are particle_binary::Effect records whose
+// strings point into the pack's table, textures are kept encoded as they were
+// on disk and any other file is stored as-is. Opening only checks the header,
+// so it takes the same time for any number of entries; an entry is checked
+// when it is looked up, and decoded when it is first used.
+namespace effect_pack
+{
+    const u32 MAGIC   = 'P' | 'F' << 8 | 'X' << 16 | 'P' << 24;
+    const u32 VERSION = 2;
+
+    // Payloads start on this boundary
+    const u32 DATA_ALIGNMENT = 16;
+
+    enum Type
+    {
+        TYPE_EFFECT = 0,
+        TYPE_TEXTURE,
+        TYPE_DATA,
+        NUM_TYPES
+    };
+
+    struct Header
+    {
+        u32 magic;
+        u32 version;
+        u32 endianTag;      // particle_binary::ENDIAN_TAG
+        u32 headerSize;     // sizeof(Header)
+        u32 entrySize;      // sizeof(Entry)
+        u32 numEntries;
+        u32 indexOffset;    // from the start of the file
+        u32 stringsOffset;
+        u32 stringsSize;
+        u32 reserved;
+    };
+
+    struct Entry
+    {
+        u32 name;           // string table offset, unique across the pack
+        u32 type;
+        u64 offset;         // payload, from the start of the file
+        u64 size;
+    };
+
+    static_assert(sizeof(Header) == 40, "Header layout is part of the format");
+    static_assert(sizeof(Entry) == 24, "Entry layout is part of the format");
+
+    // One file to write. Effects take their settings from `effect` and the
+    // texture they use from `image`, everything else from `data`.
+    struct Source
+    {
+        std::string name;
+        Type type;
+
+        particle_binary::Effect effect;
+        std::string image;
+
+        std::vector<char> data;
+    };
+
+    // Sorts the entries, false when names repeat or the file can't be written
+    bool write(const std::string& path, std::vector<Source> sources);
+}
+
+class ParticleEmitter;
+
+/// EffectPack
+// Read-only view of a pack, mapped into memory by open(). Lookups are a
+// binary search over the index. Textures are handed out encoded through
+// getData(), for a TextureLoader to decode off the main thread.
+class EffectPack
+{
+public:
+    EffectPack();
+    ~EffectPack();
+
+    // False for a missing file or a header that doesn't check out
+    bool open(const std::string& path);
+
+    // `data` must stay valid and 8 byte aligned while the pack is used
+    bool load(const void* data, size_t size);
+
+    void close();
+
+    inline bool isOpen() const { return header != nullptr; }
+
+    inline size_t getNumEntries() const { return header ? header->numEntries : 0; }
+
+    // nullptr when the entry is out of bounds of the file
+    const effect_pack::Entry* getEntry(size_t index) const;
+
+    const char* getName(const effect_pack::Entry& entry) const { return strings + entry.name; }
+
+    // nullptr when no valid entry has that name
+    const effect_pack::Entry* find(const std::string& name) const;
+
+    inline const void* getData(const effect_pack::Entry& entry) const { return pointer::add(base, entry.offset); }
+
+    // Apply an effect and hand back the name of its texture, false if there
+    // is no such effect
+    bool loadEffect(const std::string& name, ParticleEmitter& emitter, std::string& image) const;
+
+private:
+    EffectPack(const EffectPack&);
+    EffectPack& operator=(const EffectPack&);
+
+    // Forget the contents but keep the mapping
+    void reset();
+
+    const effect_pack::Header* header;
+    const effect_pack::Entry* entries;
+    const char*     strings;
+    const void*     base;
+    size_t          size;
+
+    MappedFile      mapping;
+};
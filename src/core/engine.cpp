@@ -5,8 +5,6 @@
 
 int Engine::init(Game* game, const std::string& respath)
 {
-    srand(time(NULL));
-
     // Create the main window
     sf::ContextSettings settings;
     settings.majorVersion = GL_MAJOR;
@@ -18,8 +16,12 @@ int Engine::init(Game* game, const std::string& respath)
     window.setFramerateLimit(TARGET_FPS);
     window.resetGLStates();
 
+    // Per-frame memory, shared by all threads
+    void* frameMemory = malloc(FRAME_MEMORY);
+    FrameAllocator frameAllocator(FRAME_MEMORY, frameMemory, FRAME_BLOCK);
+
     // Configure game
-    game->config(&window);
+    game->config(&window, &frameAllocator);
 
     // Add default view
     game->views.emplace_back(sf::View(sf::FloatRect(0, 0, CAM_WIDTH, CAM_HEIGHT)));
@@ -30,14 +32,19 @@ int Engine::init(Game* game, const std::string& respath)
 #endif
 
     // Initialize game
-    if(!game->init(respath)) return EXIT_FAILURE;
+    if(!game->init(respath)) {
+        free(frameMemory);
+        return EXIT_FAILURE;
+    }
 
-    loop(game, window);
+    loop(game, window, frameAllocator);
+
+    free(frameMemory);
 
     return EXIT_SUCCESS;
 }
 
-void Engine::loop(Game* game, sf::RenderWindow& window)
+void Engine::loop(Game* game, sf::RenderWindow& window, FrameAllocator& frameAllocator)
 {
     // Create a clock to track the elapsed time
     sf::Clock clock;
@@ -59,6 +66,9 @@ void Engine::loop(Game* game, sf::RenderWindow& window)
     {
         elapsed = clock.restart();
 
+        // Everything allocated for the previous frame is gone now
+        frameAllocator.clear();
+
 #if SHOW_FPS
         fps++;
         fpsTimer += elapsed;
@@ -19,5 +19,5 @@ private:
     Engine& operator=(const Engine&);
 
     int  init(Game* game, const std::string& respath);
-    void loop(Game* game, sf::RenderWindow& window);
+    void loop(Game* game, sf::RenderWindow& window, FrameAllocator& frameAllocator);
 };
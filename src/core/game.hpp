@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "config.hpp"
+#include "alloc.hpp"
 
 struct Game
 {
@@ -19,8 +20,15 @@ private:
     // Game window
     sf::RenderWindow* window;
 
+    // Cleared by the engine before every frame
+    FrameAllocator* frameAllocator;
+
     friend class Engine;
-    inline void config(sf::RenderWindow* window) { this->window = window; }
+    inline void config(sf::RenderWindow* window, FrameAllocator* frameAllocator)
+    {
+        this->window = window;
+        this->frameAllocator = frameAllocator;
+    }
 
 protected:
     // Once at start of program
@@ -59,6 +67,10 @@ protected:
     // Returns game window
     inline sf::RenderWindow& getWindow() { return *window; }
 
+    // Returns memory valid until the end of the current frame, any thread
+    // may allocate from it
+    inline FrameAllocator& getFrameAllocator() { return *frameAllocator; }
+
     // Scene views/cameras
     std::vector<sf::View> views;
 };
@@ -0,0 +1,166 @@
+#include "jobs.hpp"
+
+#include "config.hpp"
+#include "error.hpp"
+
+namespace
+{
+    // Worker slot of the calling thread, tagged with the system owning it
+    thread_local const JobSystem* tlsOwner = nullptr;
+    thread_local size_t           tlsIndex = 0;
+}
+
+JobSystem& JobSystem::get()
+{
+    static JobSystem instance(JOB_WORKERS > 0 ? JOB_WORKERS
+                              : std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return instance;
+}
+
+JobSystem::JobSystem(size_t numWorkers)
+    : queued(0), running(true)
+{
+    for(size_t i=0; i<numWorkers+1; ++i)
+        queues.push_back(new Queue);
+
+    for(size_t i=0; i<numWorkers; ++i)
+        workers.emplace_back(&JobSystem::workerLoop, this, i+1);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        running = false;
+    }
+    wakeup.notify_all();
+
+    for(auto& worker : workers)
+        worker.join();
+
+    for(auto queue : queues)
+        delete queue;
+}
+
+void JobSystem::run(const Job& job, Counter& counter)
+{
+    counter.pending++;
+
+    Queue& queue = *queues[getQueueIndex()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(Task{job, &counter});
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        queued++;
+    }
+    wakeup.notify_one();
+}
+
+void JobSystem::wait(Counter& counter)
+{
+    const size_t index = getQueueIndex();
+
+    // Help out instead of blocking, this also runs our own nested jobs
+    while(counter.pending > 0)
+    {
+        if(!tryRunOne(index))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkSize, const RangeJob& job)
+{
+    ASSERT(chunkSize > 0);
+
+    const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+    // Not worth a round trip through the queues
+    if(numChunks <= 1 || workers.empty()) {
+        for(size_t c=0; c<numChunks; ++c)
+            job(c*chunkSize, std::min(count, (c+1)*chunkSize), c);
+        return;
+    }
+
+    Counter counter;
+    for(size_t c=1; c<numChunks; ++c) {
+        const size_t begin = c*chunkSize;
+        const size_t end   = std::min(count, begin+chunkSize);
+        run([&job, begin, end, c]() { job(begin, end, c); }, counter);
+    }
+
+    // The caller takes the first chunk itself
+    job(0, std::min(count, chunkSize), 0);
+
+    wait(counter);
+}
+
+void JobSystem::workerLoop(size_t index)
+{
+    tlsOwner = this;
+    tlsIndex = index;
+
+    while(true)
+    {
+        if(tryRunOne(index))
+            continue;
+
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wakeup.wait(guard, [this]() { return queued > 0 || !running; });
+
+        if(!running && queued == 0)
+            break;
+    }
+}
+
+bool JobSystem::pop(size_t index, Task& task)
+{
+    Queue& queue = *queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+
+    if(queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool JobSystem::steal(size_t index, Task& task)
+{
+    for(size_t i=1; i<queues.size(); ++i)
+    {
+        Queue& queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if(queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    return false;
+}
+
+bool JobSystem::tryRunOne(size_t index)
+{
+    Task task;
+    if(!pop(index, task) && !steal(index, task))
+        return false;
+
+    queued--;
+
+    task.job();
+    task.counter->pending--;
+
+    return true;
+}
+
+size_t JobSystem::getQueueIndex() const
+{
+    return tlsOwner == this ? tlsIndex : 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// JobSystem
+// Fixed pool of worker threads, each with its own deque. Owners push and pop
+// at the back, idle workers steal from the front of the others. Threads that
+// wait on a counter run queued jobs instead of blocking, so jobs may spawn
+// and wait on further jobs.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Job;
+
+    // Function run by parallelFor over [begin, end) of chunk number `chunk`
+    typedef std::function<void(size_t begin, size_t end, size_t chunk)> RangeJob;
+
+    // Number of jobs still running for a batch
+    struct Counter
+    {
+        Counter() : pending(0) {}
+        std::atomic<size_t> pending;
+    };
+
+    // Shared instance, sized by JOB_WORKERS
+    static JobSystem& get();
+
+    explicit JobSystem(size_t numWorkers);
+    ~JobSystem();
+
+    void run(const Job& job, Counter& counter);
+
+    void wait(Counter& counter);
+
+    // Split [0, count) into chunks of chunkSize and wait for all of them.
+    // Chunk boundaries only depend on count and chunkSize.
+    void parallelFor(size_t count, size_t chunkSize, const RangeJob& job);
+
+    inline size_t getNumWorkers() const { return workers.size(); }
+
+private:
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    struct Task
+    {
+        Job      job;
+        Counter* counter;
+    };
+
+    struct Queue
+    {
+        std::mutex       lock;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+
+    bool pop(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+    bool tryRunOne(size_t index);
+
+    size_t getQueueIndex() const;
+
+    // Queue 0 is shared by all non-worker threads, workers own 1..N
+    std::vector<Queue*>       queues;
+    std::vector<std::thread>  workers;
+
+    std::mutex                sleepLock;
+    std::condition_variable   wakeup;
+    std::atomic<size_t>       queued;
+    std::atomic<bool>         running;
+};
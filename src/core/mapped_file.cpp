@@ -0,0 +1,81 @@
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : data(nullptr), size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    #if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    HANDLE view = nullptr;
+    if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if(view == nullptr)
+        return false;
+
+    void* p = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(view);
+
+    if(p == nullptr)
+        return false;
+
+    data = p;
+    size = fileSize.QuadPart;
+    #else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    void* p = MAP_FAILED;
+    struct stat info;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+        p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(p == MAP_FAILED)
+        return false;
+
+    data = p;
+    size = info.st_size;
+    #endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(data) {
+        #if defined(_WIN32)
+        UnmapViewOfFile(data);
+        #else
+        munmap(data, size);
+        #endif
+    }
+
+    data = nullptr;
+    size = 0;
+}
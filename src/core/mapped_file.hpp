@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "pointer.hpp"
+
+/// MappedFile
+// Read-only mapping of a whole file, pages are only read in when touched
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // False for a missing or empty file
+    bool open(const std::string& path);
+
+    void close();
+
+    inline bool isOpen() const { return data != nullptr; }
+
+    inline const void* getData() const { return data; }
+
+    inline size_t getSize() const { return size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void*   data;
+    size_t  size;
+};
@@ -0,0 +1,220 @@
+#include "particle_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#include "jobs.hpp"
+#include "constants.hpp"
+
+namespace
+{
+    // The six blend mode fields, 4 bits each
+    inline u32 blendKey(const sf::BlendMode& mode)
+    {
+        return mode.colorSrcFactor       | mode.colorDstFactor << 4  | mode.colorEquation << 8 |
+               mode.alphaSrcFactor << 12 | mode.alphaDstFactor << 16 | mode.alphaEquation << 20;
+    }
+
+    inline bool isIdentity(const float* m)
+    {
+        return m[0] == 1 && m[1] == 0 && m[4] == 0 && m[5] == 1 && m[12] == 0 && m[13] == 0;
+    }
+}
+
+ParticleBatch::ParticleBatch(Allocator& allocator)
+    : items(allocator),
+      groups(allocator),
+      vertices(allocator),
+      numVertices(0)
+{
+}
+
+void ParticleBatch::clear()
+{
+    items.clear();
+    groups.clear();
+    numVertices = 0;
+}
+
+void ParticleBatch::add(const ParticleEmitter& emitter)
+{
+    if(emitter.getVertexCount() == 0)
+        return;
+
+    Item item;
+    item.texture   = emitter.getTexture();
+    item.blendMode = emitter.blendMode;
+    item.shader    = emitter.getShader();
+    item.primitive = emitter.getPrimitiveType();
+    item.texRect   = item.shader ? emitter.getNormalizedTextureRect() : sf::FloatRect(0, 0, 1, 1);
+    item.emitter   = &emitter;
+    item.radius    = 0;
+    item.thickness = 0;
+    item.order     = items.size();
+    item.group     = 0;
+    item.first     = 0;
+    item.count     = emitter.getVertexCount();
+    items.push_back(item);
+}
+
+void ParticleBatch::addCircle(const sf::Vector2f& center, float radius, const sf::Color& color, float thickness)
+{
+    Item item;
+    item.texture   = nullptr;
+    item.blendMode = sf::BlendAlpha;
+    item.shader    = nullptr;
+    item.primitive = sf::Quads;
+    item.texRect   = sf::FloatRect(0, 0, 1, 1);
+    item.emitter   = nullptr;
+    item.center    = center;
+    item.radius    = radius;
+    item.thickness = thickness;
+    item.color     = color;
+    item.order     = items.size();
+    item.group     = 0;
+    item.first     = 0;
+    item.count     = BATCH_CIRCLE_POINTS*4;
+    items.push_back(item);
+}
+
+bool ParticleBatch::lessByGroup(const Item& a, const Item& b)
+{
+    if(a.group != b.group)
+        return a.group < b.group;
+    return a.order < b.order;
+}
+
+bool ParticleBatch::sameKey(const Item& item, const Group& group)
+{
+    return item.texture == group.texture && item.shader == group.shader && item.primitive == group.primitive &&
+           blendKey(item.blendMode) == blendKey(group.blendMode) && item.texRect == group.texRect;
+}
+
+void ParticleBatch::build()
+{
+    groups.clear();
+
+    // a group per distinct key, numbered by first appearance
+    for(Item& item : items) {
+        size_t g = 0;
+        while(g < groups.size() && !sameKey(item, groups[g]))
+            ++g;
+
+        if(g == groups.size()) {
+            Group group;
+            group.texture   = item.texture;
+            group.blendMode = item.blendMode;
+            group.shader    = item.shader;
+            group.primitive = item.primitive;
+            group.texRect   = item.texRect;
+            group.first     = 0;
+            group.count     = 0;
+            groups.push_back(group);
+        }
+
+        item.group = g;
+        groups[g].count += item.count;
+    }
+
+    // the order tie break keeps this deterministic without a stable sort
+    std::sort(items.begin(), items.end(), lessByGroup);
+
+    numVertices = 0;
+    for(Group& group : groups) {
+        group.first = numVertices;
+        numVertices += group.count;
+    }
+
+    size_t first = 0;
+    for(Item& item : items) {
+        item.first = first;
+        first += item.count;
+    }
+
+    // only ever grows, so steady frames don't allocate
+    if(vertices.size() < numVertices)
+        vertices.resize(numVertices);
+
+    JobSystem::get().parallelFor(items.size(), BATCH_CHUNK, [this](size_t begin, size_t end, size_t chunk) {
+        for(size_t i=begin; i<end; ++i)
+            buildItem(items[i]);
+    });
+}
+
+sf::FloatRect ParticleBatch::getViewBounds(const sf::View& view)
+{
+    // clip space corners back to the world
+    return view.getTransform().getInverse().transformRect(sf::FloatRect(-1, -1, 2, 2));
+}
+
+bool ParticleBatch::isVisible(const ParticleEmitter& emitter, const sf::FloatRect& area)
+{
+    if(emitter.getAliveCount() == 0)
+        return false;
+
+    return emitter.getTransform().transformRect(emitter.getBounds()).intersects(area);
+}
+
+void ParticleBatch::buildItem(const Item& item)
+{
+    sf::Vertex* out = vertices.data() + item.first;
+
+    if(item.emitter) {
+        const sf::Vertex* in = item.emitter->getVertices();
+        const float* m = item.emitter->getTransform().getMatrix();
+
+        if(isIdentity(m)) {
+            memcpy(out, in, item.count * sizeof(sf::Vertex));
+            return;
+        }
+
+        // 2D affine part of the 4x4 column major matrix
+        for(size_t i=0; i<item.count; ++i) {
+            const sf::Vector2f& p = in[i].position;
+            out[i].position  = sf::Vector2f(m[0]*p.x + m[4]*p.y + m[12], m[1]*p.x + m[5]*p.y + m[13]);
+            out[i].color     = in[i].color;
+            out[i].texCoords = in[i].texCoords;
+        }
+        return;
+    }
+
+    // outline ring, one quad per segment
+    const float inner = item.radius;
+    const float outer = item.radius + item.thickness;
+    const float step  = 2*PI / BATCH_CIRCLE_POINTS;
+
+    sf::Vector2f from(1, 0);
+    for(size_t i=0; i<BATCH_CIRCLE_POINTS; ++i) {
+        const sf::Vector2f to(std::cos((i+1)*step), std::sin((i+1)*step));
+
+        out[0].position = item.center + from*inner;
+        out[1].position = item.center + from*outer;
+        out[2].position = item.center + to*outer;
+        out[3].position = item.center + to*inner;
+        for(size_t c=0; c<4; ++c) {
+            out[c].color     = item.color;
+            out[c].texCoords = sf::Vector2f(0, 0);
+        }
+
+        out += 4;
+        from = to;
+    }
+}
+
+void ParticleBatch::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    for(const Group& group : groups) {
+        states.texture   = group.texture;
+        states.blendMode = group.blendMode;
+        states.shader    = group.shader;
+
+        if(group.shader)
+            ParticleEmitter::preparePointShader(*group.shader, target, group.texRect);
+
+        target.draw(vertices.data() + group.first, group.count, group.primitive, states);
+
+        if(group.shader)
+            ParticleEmitter::finishPointShader();
+    }
+}
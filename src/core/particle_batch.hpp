@@ -0,0 +1,106 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "alloc.hpp"
+#include "particlefx.hpp"
+
+// Items whose vertices one job copies and transforms into the batch
+#define BATCH_CHUNK 16
+
+// Segments of a gizmo circle, the same as an sf::CircleShape
+#define BATCH_CIRCLE_POINTS 30
+
+/// ParticleBatch
+// Collects the geometry of many emitters and gizmos and draws it with one
+// call per group of items sharing (texture, blend mode, shader, primitive),
+// and for point shaders the texture rectangle as well. Quads carry their own
+// texture coordinates, so emitters using different regions of one atlas page
+// share a group.
+// Emitter transforms are applied while copying, so the whole batch is in
+// world space. Groups are drawn in the order their first item was added and
+// items keep their order within a group, so only overlapping items of
+// different groups can end up drawn in another order.
+//
+// Building never touches the GPU: after build() the groups and the shared
+// vertex array can be inspected directly.
+class ParticleBatch : public sf::Drawable
+{
+public:
+    // One draw call worth of vertices, [first, first+count)
+    struct Group
+    {
+        const sf::Texture*  texture;
+        sf::BlendMode       blendMode;
+        sf::Shader*         shader;
+        sf::PrimitiveType   primitive;
+        sf::FloatRect       texRect;    // normalized, only used by shaders
+
+        size_t              first;
+        size_t              count;
+    };
+
+    // The vertex array keeps its capacity between frames, it is drawn from
+    // `allocator`, which has to be able to free single blocks
+    explicit ParticleBatch(Allocator& allocator = mem::getDefaultAllocator());
+
+    // Forget every item, nothing is freed
+    void clear();
+
+    // Queue the living particles of `emitter`, as built by its last update.
+    // The emitter must not change until the batch is built.
+    void add(const ParticleEmitter& emitter);
+
+    // Queue an untextured circle outline, alpha blended
+    void addCircle(const sf::Vector2f& center, float radius, const sf::Color& color, float thickness = 1.f);
+
+    // Group the queued items and fill the vertex array
+    void build();
+
+    // World space box seen through `view`, or the box around it when the
+    // view is rotated
+    static sf::FloatRect getViewBounds(const sf::View& view);
+
+    // Whether the living particles of `emitter` may reach into `area`
+    static bool isVisible(const ParticleEmitter& emitter, const sf::FloatRect& area);
+
+    inline const mem::Vector<Group>& getGroups() const { return groups; }
+
+    inline const sf::Vertex* getVertices() const { return vertices.data(); }
+
+    inline size_t getVertexCount() const { return numVertices; }
+
+private:
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+
+    struct Item
+    {
+        const sf::Texture*      texture;
+        sf::BlendMode           blendMode;
+        sf::Shader*             shader;
+        sf::PrimitiveType       primitive;
+        sf::FloatRect           texRect;
+
+        // nullptr for a circle
+        const ParticleEmitter*  emitter;
+        sf::Vector2f            center;
+        float                   radius;
+        float                   thickness;
+        sf::Color               color;
+
+        size_t                  order;
+        size_t                  group;
+        size_t                  first;
+        size_t                  count;
+    };
+
+    static bool lessByGroup(const Item& a, const Item& b);
+    static bool sameKey(const Item& item, const Group& group);
+
+    void buildItem(const Item& item);
+
+    mem::Vector<Item>       items;
+    mem::Vector<Group>      groups;
+    mem::Vector<sf::Vertex> vertices;
+    size_t                  numVertices;
+};
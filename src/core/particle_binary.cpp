@@ -0,0 +1,216 @@
+#include "particle_binary.hpp"
+
+#include <string.h>
+#include <fstream>
+
+#include "particlefx.hpp"
+
+namespace particle_binary
+{
+
+void store(const ParticleEmitter& e, Effect& effect)
+{
+    effect.count    = e.count;
+    effect.seed     = e.seed;
+    effect.burst    = e.burst;
+    effect.rate     = e.rate;
+
+    effect.emitterX = e.emitter.x; effect.emitterY = e.emitter.y;
+    effect.offsetX  = e.offset.x;  effect.offsetY  = e.offset.y;
+    effect.forceX   = e.force.x;   effect.forceY   = e.force.y;
+    effect.torque   = e.torque;
+
+    effect.blend[0] = e.blendMode.colorSrcFactor;
+    effect.blend[1] = e.blendMode.colorDstFactor;
+    effect.blend[2] = e.blendMode.colorEquation;
+    effect.blend[3] = e.blendMode.alphaSrcFactor;
+    effect.blend[4] = e.blendMode.alphaDstFactor;
+    effect.blend[5] = e.blendMode.alphaEquation;
+
+    effect.startColor[0] = e.startColor.r; effect.startColor[1] = e.startColor.g; effect.startColor[2] = e.startColor.b;
+    effect.endColor[0]   = e.endColor.r;   effect.endColor[1]   = e.endColor.g;   effect.endColor[2]   = e.endColor.b;
+
+    effect.minLife   = e.minLife;   effect.maxLife   = e.maxLife;
+    effect.minAngle  = e.minAngle;  effect.maxAngle  = e.maxAngle;
+    effect.minSpeed  = e.minSpeed;  effect.maxSpeed  = e.maxSpeed;
+    effect.minTorque = e.minTorque; effect.maxTorque = e.maxTorque;
+    effect.minSize   = e.minSize;   effect.maxSize   = e.maxSize;
+
+    effect.frameColumns     = e.frameColumns;
+    effect.frameRows        = e.frameRows;
+    effect.frameCount       = e.frameCount;
+    effect.frameRate        = e.frameRate;
+    effect.randomStartFrame = e.randomStartFrame;
+}
+
+void apply(const Effect& effect, ParticleEmitter& e)
+{
+    e.count    = effect.count;
+    e.seed     = effect.seed;
+    e.burst    = effect.burst;
+    e.rate     = effect.rate;
+
+    e.emitter  = sf::Vector2f(effect.emitterX, effect.emitterY);
+    e.offset   = sf::Vector2f(effect.offsetX, effect.offsetY);
+    e.force    = sf::Vector2f(effect.forceX, effect.forceY);
+    e.torque   = effect.torque;
+
+    e.blendMode.colorSrcFactor = (sf::BlendMode::Factor)effect.blend[0];
+    e.blendMode.colorDstFactor = (sf::BlendMode::Factor)effect.blend[1];
+    e.blendMode.colorEquation  = (sf::BlendMode::Equation)effect.blend[2];
+    e.blendMode.alphaSrcFactor = (sf::BlendMode::Factor)effect.blend[3];
+    e.blendMode.alphaDstFactor = (sf::BlendMode::Factor)effect.blend[4];
+    e.blendMode.alphaEquation  = (sf::BlendMode::Equation)effect.blend[5];
+
+    e.startColor = sf::Color(effect.startColor[0], effect.startColor[1], effect.startColor[2]);
+    e.endColor   = sf::Color(effect.endColor[0], effect.endColor[1], effect.endColor[2]);
+
+    e.minLife   = effect.minLife;   e.maxLife   = effect.maxLife;
+    e.minAngle  = effect.minAngle;  e.maxAngle  = effect.maxAngle;
+    e.minSpeed  = effect.minSpeed;  e.maxSpeed  = effect.maxSpeed;
+    e.minTorque = effect.minTorque; e.maxTorque = effect.maxTorque;
+    e.minSize   = effect.minSize;   e.maxSize   = effect.maxSize;
+
+    e.frameColumns     = effect.frameColumns;
+    e.frameRows        = effect.frameRows;
+    e.frameCount       = effect.frameCount;
+    e.frameRate        = effect.frameRate;
+    e.randomStartFrame = effect.randomStartFrame != 0;
+}
+
+bool write(const std::string& path, const std::vector<Entry>& entries)
+{
+    std::vector<Effect> effects(entries.size());
+    std::string strings;
+
+    for(size_t i=0; i<entries.size(); ++i) {
+        effects[i] = entries[i].effect;
+
+        effects[i].name = strings.size();
+        strings.append(entries[i].name.c_str(), entries[i].name.size() + 1);
+
+        effects[i].image = strings.size();
+        strings.append(entries[i].image.c_str(), entries[i].image.size() + 1);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic         = MAGIC;
+    header.version       = VERSION;
+    header.endianTag     = ENDIAN_TAG;
+    header.headerSize    = sizeof(Header);
+    header.effectSize    = sizeof(Effect);
+    header.numEffects    = effects.size();
+    header.effectsOffset = sizeof(Header);
+    header.stringsOffset = sizeof(Header) + effects.size() * sizeof(Effect);
+    header.stringsSize   = strings.size();
+
+    std::ofstream os(path, std::ios::binary);
+    os.write((const char*)&header, sizeof(header));
+    os.write((const char*)effects.data(), effects.size() * sizeof(Effect));
+    os.write(strings.data(), strings.size());
+
+    return bool(os);
+}
+
+
+/// File
+File::File()
+    : header(nullptr), effects(nullptr), strings(nullptr)
+{
+}
+
+File::~File()
+{
+    close();
+}
+
+bool File::open(const std::string& path)
+{
+    close();
+
+    if(!mapping.open(path))
+        return false;
+
+    if(!load(mapping.getData(), mapping.getSize())) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool File::load(const void* data, size_t size)
+{
+    header  = nullptr;
+    effects = nullptr;
+    strings = nullptr;
+
+    const Header* h = (const Header*)data;
+
+    if(size < sizeof(Header) || pointer::alignForwardAdjustment(data, __alignof(Header)) != 0)
+        return false;
+
+    // records are used in place, so only the current layout is read: newer
+    // versions may change it, and version 1 records lack the flipbook fields
+    // and have to be converted from their .pfx source again
+    if(h->magic != MAGIC || h->version != VERSION || h->endianTag != ENDIAN_TAG ||
+       h->headerSize != sizeof(Header) || h->effectSize != sizeof(Effect))
+        return false;
+
+    // every part has to lie within the file, without overflowing
+    const u64 effectsEnd = u64(h->effectsOffset) + u64(h->numEffects) * sizeof(Effect);
+    const u64 stringsEnd = u64(h->stringsOffset) + h->stringsSize;
+
+    if(h->effectsOffset < sizeof(Header) || h->effectsOffset % __alignof(Effect) != 0 ||
+       effectsEnd > size || stringsEnd > size)
+        return false;
+
+    const char* s = (const char*)data + h->stringsOffset;
+    if(h->stringsSize > 0 && s[h->stringsSize - 1] != '\0')
+        return false;
+
+    // names and images must point into the string table, which ends in a
+    // terminator, so every string stays in bounds
+    const Effect* e = (const Effect*)pointer::add(data, h->effectsOffset);
+    for(u32 i=0; i<h->numEffects; ++i) {
+        if(e[i].name >= h->stringsSize || e[i].image >= h->stringsSize)
+            return false;
+    }
+
+    header  = h;
+    effects = e;
+    strings = s;
+    return true;
+}
+
+void File::close()
+{
+    header  = nullptr;
+    effects = nullptr;
+    strings = nullptr;
+
+    mapping.close();
+}
+
+const Effect* File::findEffect(const std::string& name) const
+{
+    for(size_t i=0; i<getNumEffects(); ++i) {
+        if(name == getString(effects[i].name))
+            return &effects[i];
+    }
+    return nullptr;
+}
+
+bool loadFirst(const std::string& path, ParticleEmitter& emitter, std::string& image)
+{
+    File file;
+    if(!file.open(path) || file.getNumEffects() == 0)
+        return false;
+
+    apply(file.getEffect(0), emitter);
+    image = file.getString(file.getEffect(0).image);
+    return true;
+}
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pointer.hpp"
+#include "mapped_file.hpp"
+
+class ParticleEmitter;
+
+// Fixed layout binary effect files. A file is a Header, an array of Effect
+// records and a table of null terminated strings, all little endian. Loading
+// maps the file and checks the header once, the records are then used in
+// place without any parsing.
+namespace particle_binary
+{
+    const u32 MAGIC   = 'P' | 'F' << 8 | 'X' << 16 | 'B' << 24;
+    const u32 VERSION = 2;
+
+    // Written as-is, reads back as 0x01020304 only on a host of the same
+    // byte order
+    const u32 ENDIAN_TAG = 0x01020304;
+
+    struct Header
+    {
+        u32 magic;
+        u32 version;
+        u32 endianTag;
+        u32 headerSize;     // sizeof(Header)
+        u32 effectSize;     // sizeof(Effect)
+        u32 numEffects;
+        u32 effectsOffset;  // from the start of the file
+        u32 stringsOffset;
+        u32 stringsSize;
+        u32 reserved;
+    };
+
+    // Every serialized ParticleEmitter field, see
+    // ParticleEmitter::serializeFields(). A field added there has to be added
+    // here as well, with VERSION bumped, or binary packs silently lose it.
+    struct Effect
+    {
+        u32 name;           // string table offsets
+        u32 image;
+
+        u32 count;
+        u32 seed;
+        u32 burst;
+        float rate;
+
+        float emitterX, emitterY;
+        float offsetX, offsetY;
+        float forceX, forceY;
+        float torque;
+
+        u8 blend[6];        // colour src, dst, equation, then alpha
+        u8 startColor[3];
+        u8 endColor[3];
+
+        float minLife,   maxLife;
+        float minAngle,  maxAngle;
+        float minSpeed,  maxSpeed;
+        float minTorque, maxTorque;
+        float minSize,   maxSize;
+
+        u32 frameColumns, frameRows;
+        u32 frameCount;
+        float frameRate;
+        u32 randomStartFrame;
+    };
+
+    static_assert(sizeof(Header) == 40, "Header layout is part of the format");
+    static_assert(sizeof(Effect) == 124, "Effect layout is part of the format");
+
+    // Copy the emitter settings to and from a record, the strings are left
+    // to the caller
+    void store(const ParticleEmitter& emitter, Effect& effect);
+    void apply(const Effect& effect, ParticleEmitter& emitter);
+
+    // One effect to write, named for lookups
+    struct Entry
+    {
+        std::string name;
+        std::string image;
+        Effect effect;
+    };
+
+    bool write(const std::string& path, const std::vector<Entry>& entries);
+
+    /// File
+    // Read-only view of a binary effect file, mapped into memory by open()
+    // or wrapping a caller owned buffer with load()
+    class File
+    {
+    public:
+        File();
+        ~File();
+
+        // False for a missing file or a header that doesn't check out
+        bool open(const std::string& path);
+
+        // `data` must stay valid and 4 byte aligned while the file is used
+        bool load(const void* data, size_t size);
+
+        void close();
+
+        inline bool isOpen() const { return header != nullptr; }
+
+        inline size_t getNumEffects() const { return header ? header->numEffects : 0; }
+
+        inline const Effect& getEffect(size_t index) const { return effects[index]; }
+
+        // nullptr when no effect has that name
+        const Effect* findEffect(const std::string& name) const;
+
+        inline const char* getString(u32 offset) const { return strings + offset; }
+
+    private:
+        File(const File&);
+        File& operator=(const File&);
+
+        const Header*   header;
+        const Effect*   effects;
+        const char*     strings;
+
+        MappedFile      mapping;
+    };
+
+    // Apply the first effect of a binary file, false when `path` isn't one
+    bool loadFirst(const std::string& path, ParticleEmitter& emitter, std::string& image);
+}
@@ -0,0 +1,143 @@
+#include "particle_data.hpp"
+
+#include <string.h>
+#include <utility>
+
+#include "error.hpp"
+
+static_assert(sizeof(sf::Color) == sizeof(float), "Color stream must match float stream width");
+static_assert(pointer::isPowerOfTwo(PARTICLE_ALIGNMENT), "Particle alignment must be a power of two");
+
+namespace
+{
+    const size_t STREAM_COUNT = 11;
+    const size_t LANES        = PARTICLE_ALIGNMENT / sizeof(float);
+
+    inline size_t padCount(size_t count)
+    {
+        return (count + LANES - 1) / LANES * LANES;
+    }
+
+    inline void gatherStreams(ParticleData& d, float** streams)
+    {
+        float* s[STREAM_COUNT] = { d.posX, d.posY, d.velX, d.velY, d.life, d.lifetime, d.size, d.rotation, (float*)d.color,
+                                   d.frame, d.frameStart };
+        for(size_t i=0; i<STREAM_COUNT; ++i)
+            streams[i] = s[i];
+    }
+}
+
+ParticleData::ParticleData(Allocator& allocator)
+    : count(0),
+      posX(nullptr), posY(nullptr),
+      velX(nullptr), velY(nullptr),
+      life(nullptr), lifetime(nullptr),
+      size(nullptr), rotation(nullptr),
+      color(nullptr),
+      frame(nullptr), frameStart(nullptr),
+      allocator(&allocator),
+      block(nullptr),
+      stride(0)
+{
+}
+
+ParticleData::~ParticleData()
+{
+    if(block)
+        allocator->deallocate(block);
+}
+
+ParticleData::ParticleData(ParticleData&& other)
+    : ParticleData(*other.allocator)
+{
+    swap(other);
+}
+
+ParticleData& ParticleData::operator=(ParticleData&& other)
+{
+    // other frees our old block, with our old allocator
+    swap(other);
+    return *this;
+}
+
+void ParticleData::swap(ParticleData& other)
+{
+    std::swap(count, other.count);
+    std::swap(posX, other.posX);
+    std::swap(posY, other.posY);
+    std::swap(velX, other.velX);
+    std::swap(velY, other.velY);
+    std::swap(life, other.life);
+    std::swap(lifetime, other.lifetime);
+    std::swap(size, other.size);
+    std::swap(rotation, other.rotation);
+    std::swap(color, other.color);
+    std::swap(frame, other.frame);
+    std::swap(frameStart, other.frameStart);
+    std::swap(allocator, other.allocator);
+    std::swap(block, other.block);
+    std::swap(stride, other.stride);
+}
+
+bool ParticleData::resize(size_t count)
+{
+    const size_t newStride = padCount(count);
+
+    if(newStride == stride) {
+        // Grown particles start zeroed, like a value-initialized Particle
+        if(count > this->count) {
+            float* streams[STREAM_COUNT];
+            gatherStreams(*this, streams);
+            for(size_t i=0; i<STREAM_COUNT; ++i)
+                memset(streams[i] + this->count, 0, (count - this->count) * sizeof(float));
+        }
+        this->count = count;
+        return true;
+    }
+
+    void* newBlock = nullptr;
+    float* streams[STREAM_COUNT] = {};
+
+    if(newStride > 0) {
+        ALLOC_SITE();
+        newBlock = mem::allocateAligned<PARTICLE_ALIGNMENT>(*allocator, newStride * sizeof(float) * STREAM_COUNT);
+        if(newBlock == nullptr)
+            return false;
+
+        float* p = (float*)newBlock;
+        for(size_t i=0; i<STREAM_COUNT; ++i)
+            streams[i] = p + i*newStride;
+
+        memset(streams[0], 0, newStride * sizeof(float) * STREAM_COUNT);
+    }
+
+    // Carry over existing particles, stream by stream
+    const size_t keep = this->count < count ? this->count : count;
+    if(keep > 0) {
+        float* old[STREAM_COUNT];
+        gatherStreams(*this, old);
+        for(size_t i=0; i<STREAM_COUNT; ++i)
+            memcpy(streams[i], old[i], keep * sizeof(float));
+    }
+
+    if(block)
+        allocator->deallocate(block);
+
+    block    = newBlock;
+    stride   = newStride;
+
+    posX     = streams[0];
+    posY     = streams[1];
+    velX     = streams[2];
+    velY     = streams[3];
+    life     = streams[4];
+    lifetime = streams[5];
+    size     = streams[6];
+    rotation = streams[7];
+    color    = (sf::Color*)streams[8];
+    frame    = streams[9];
+    frameStart = streams[10];
+
+    this->count = count;
+    return true;
+}
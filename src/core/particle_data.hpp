@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <SFML/Graphics/Color.hpp>
+
+#include "pointer.hpp"
+#include "alloc.hpp"
+
+// Every stream starts on this boundary and is padded to a multiple of it,
+// so vector loops can always run whole registers over the tail and no two
+// streams share a cache line.
+#define PARTICLE_ALIGNMENT 64
+
+/// ParticleData
+// Structure-of-arrays storage for the particles of an emitter. Each attribute
+// lives in its own contiguous stream so a pass only touches what it reads.
+struct ParticleData
+{
+    // The streams live in one block from `allocator`, which has to be able
+    // to free single blocks
+    explicit ParticleData(Allocator& allocator = mem::getDefaultAllocator());
+    ~ParticleData();
+
+    // Moving hands over the block, the source is left empty
+    ParticleData(ParticleData&& other);
+    ParticleData& operator=(ParticleData&& other);
+
+    // Resize all streams, keeping the first min(count, newCount) particles.
+    // Returns false and leaves the streams untouched when out of memory.
+    bool resize(size_t count);
+
+    // Copy particle `from` over particle `to`
+    inline void move(size_t from, size_t to)
+    {
+        posX[to]     = posX[from];
+        posY[to]     = posY[from];
+        velX[to]     = velX[from];
+        velY[to]     = velY[from];
+        life[to]     = life[from];
+        lifetime[to] = lifetime[from];
+        size[to]     = size[from];
+        rotation[to] = rotation[from];
+        color[to]    = color[from];
+        frame[to]    = frame[from];
+        frameStart[to] = frameStart[from];
+    }
+
+    // Number of elements allocated per stream (count rounded up for padding)
+    inline size_t getStride() const { return stride; }
+
+    inline Allocator& getAllocator() const { return *allocator; }
+
+    size_t      count;
+
+    float*      posX;
+    float*      posY;
+    float*      velX;
+    float*      velY;
+    float*      life;
+    float*      lifetime;
+    float*      size;
+    float*      rotation;
+    sf::Color*  color;
+
+    // Flipbook frame shown and the one the particle started on, whole
+    // numbers kept as floats like the other streams
+    float*      frame;
+    float*      frameStart;
+
+private:
+    ParticleData(const ParticleData&);
+    ParticleData& operator=(const ParticleData&);
+
+    void swap(ParticleData& other);
+
+    Allocator*  allocator;
+    void*       block;
+    size_t      stride;
+};
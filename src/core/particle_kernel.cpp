@@ -0,0 +1,289 @@
+#include "particle_kernel.hpp"
+
+#include <cmath>
+
+// Vector paths are built with per-function target attributes, so the rest of
+// the project keeps its baseline flags and the best path is picked at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define PARTICLE_KERNEL_X86 1
+    #include <immintrin.h>
+#else
+    #define PARTICLE_KERNEL_X86 0
+#endif
+
+namespace particle_kernel
+{
+
+namespace
+{
+    Isa currentIsa = detect();
+}
+
+Isa detect()
+{
+#if PARTICLE_KERNEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if(__builtin_cpu_supports("sse2")) return ISA_SSE2;
+#endif
+    return ISA_SCALAR;
+}
+
+Isa getIsa()
+{
+    return currentIsa;
+}
+
+void setIsa(Isa isa)
+{
+    // Never select a path this CPU can't run
+    currentIsa = isa < detect() ? isa : detect();
+}
+
+const char* getIsaName(Isa isa)
+{
+    switch(isa)
+    {
+    case ISA_AVX2: return "avx2";
+    case ISA_SSE2: return "sse2";
+    default:       return "scalar";
+    }
+}
+
+void integrateParticle(ParticleData& p, size_t i, const Params& k)
+{
+    p.rotation[i] += k.torque * k.dt;
+    p.velX[i] += k.forceX;
+    p.velY[i] += k.forceY;
+    p.posX[i] += p.velX[i] * k.dt;
+    p.posY[i] += p.velY[i] * k.dt;
+
+    // update the alpha (transparency) of the particle according to its lifetime
+    float ratio = p.life[i] / p.lifetime[i];
+    sf::Color& color = p.color[i];
+    color.r = static_cast<sf::Uint8>((1-ratio)*k.endR + ratio*k.startR);
+    color.g = static_cast<sf::Uint8>((1-ratio)*k.endG + ratio*k.startG);
+    color.b = static_cast<sf::Uint8>((1-ratio)*k.endB + ratio*k.startB);
+    color.a = static_cast<sf::Uint8>(ratio * 255);
+
+    // flipbook frame, counted on from the start frame and wrapped around
+    if(k.frames > 1) {
+        const float age = p.lifetime[i] - p.life[i];
+        const float frame = p.frameStart[i] + static_cast<int>((1-ratio)*k.framesPerLife + age*k.framesPerSecond);
+        p.frame[i] = frame - static_cast<int>(frame / k.frames) * k.frames;
+    }
+}
+
+size_t integrate(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    switch(currentIsa)
+    {
+    case ISA_AVX2: return integrateAVX2(p, begin, end, k, dead);
+    case ISA_SSE2: return integrateSSE2(p, begin, end, k, dead);
+    default:       return integrateScalar(p, begin, end, k, dead);
+    }
+}
+
+Bounds bounds(const ParticleData& p, size_t begin, size_t end, float extent)
+{
+    Bounds b;
+    b.minX = b.minY =  INFINITY;
+    b.maxX = b.maxY = -INFINITY;
+
+    // written as compare and select so it becomes min/max instructions
+    for(size_t i=begin; i<end; ++i)
+    {
+        const float r = p.size[i] * extent;
+        const float x0 = p.posX[i] - r, x1 = p.posX[i] + r;
+        const float y0 = p.posY[i] - r, y1 = p.posY[i] + r;
+
+        b.minX = x0 < b.minX ? x0 : b.minX;
+        b.minY = y0 < b.minY ? y0 : b.minY;
+        b.maxX = x1 > b.maxX ? x1 : b.maxX;
+        b.maxY = y1 > b.maxY ? y1 : b.maxY;
+    }
+
+    return b;
+}
+
+size_t integrateScalar(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    size_t numDead = 0;
+
+    for(size_t i=begin; i<end; ++i)
+    {
+        // update the particle lifetime, dead ones are left to the caller
+        p.life[i] -= k.dt;
+
+        if(p.life[i] <= 0) {
+            dead[numDead++] = i;
+            continue;
+        }
+
+        integrateParticle(p, i, k);
+    }
+
+    return numDead;
+}
+
+#if PARTICLE_KERNEL_X86
+
+__attribute__((target("sse2")))
+size_t integrateSSE2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    const __m128 dt      = _mm_set1_ps(k.dt);
+    const __m128 rot     = _mm_set1_ps(k.torque * k.dt);
+    const __m128 forceX  = _mm_set1_ps(k.forceX);
+    const __m128 forceY  = _mm_set1_ps(k.forceY);
+    const __m128 startR  = _mm_set1_ps(k.startR);
+    const __m128 startG  = _mm_set1_ps(k.startG);
+    const __m128 startB  = _mm_set1_ps(k.startB);
+    const __m128 endR    = _mm_set1_ps(k.endR);
+    const __m128 endG    = _mm_set1_ps(k.endG);
+    const __m128 endB    = _mm_set1_ps(k.endB);
+    const __m128 one     = _mm_set1_ps(1.f);
+    const __m128 alpha   = _mm_set1_ps(255.f);
+    const __m128 zero    = _mm_setzero_ps();
+    const __m128 frames  = _mm_set1_ps(k.frames);
+    const __m128 perLife = _mm_set1_ps(k.framesPerLife);
+    const __m128 perSec  = _mm_set1_ps(k.framesPerSecond);
+    const bool animated  = k.frames > 1;
+
+    size_t numDead = 0;
+    size_t i = begin;
+
+    for(; i+4 <= end; i+=4)
+    {
+        const __m128 life = _mm_sub_ps(_mm_loadu_ps(p.life+i), dt);
+        _mm_storeu_ps(p.life+i, life);
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(life, zero));
+        while(mask) {
+            dead[numDead++] = i + __builtin_ctz(mask);
+            mask &= mask-1;
+        }
+
+        _mm_storeu_ps(p.rotation+i, _mm_add_ps(_mm_loadu_ps(p.rotation+i), rot));
+
+        const __m128 velX = _mm_add_ps(_mm_loadu_ps(p.velX+i), forceX);
+        const __m128 velY = _mm_add_ps(_mm_loadu_ps(p.velY+i), forceY);
+        _mm_storeu_ps(p.velX+i, velX);
+        _mm_storeu_ps(p.velY+i, velY);
+        _mm_storeu_ps(p.posX+i, _mm_add_ps(_mm_loadu_ps(p.posX+i), _mm_mul_ps(velX, dt)));
+        _mm_storeu_ps(p.posY+i, _mm_add_ps(_mm_loadu_ps(p.posY+i), _mm_mul_ps(velY, dt)));
+
+        const __m128 lifetime = _mm_loadu_ps(p.lifetime+i);
+        const __m128 ratio = _mm_div_ps(life, lifetime);
+        const __m128 inv   = _mm_sub_ps(one, ratio);
+
+        const __m128i r = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(inv, endR), _mm_mul_ps(ratio, startR)));
+        const __m128i g = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(inv, endG), _mm_mul_ps(ratio, startG)));
+        const __m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(inv, endB), _mm_mul_ps(ratio, startB)));
+        const __m128i a = _mm_cvttps_epi32(_mm_mul_ps(ratio, alpha));
+
+        // sf::Color is r,g,b,a in memory, i.e. little-endian 0xAABBGGRR
+        const __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                          _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+        _mm_storeu_si128((__m128i*)(p.color+i), rgba);
+
+        // truncating through int32 is the scalar static_cast<int>
+        if(animated) {
+            const __m128 age   = _mm_sub_ps(lifetime, life);
+            const __m128 steps = _mm_add_ps(_mm_mul_ps(inv, perLife), _mm_mul_ps(age, perSec));
+            const __m128 frame = _mm_add_ps(_mm_loadu_ps(p.frameStart+i), _mm_cvtepi32_ps(_mm_cvttps_epi32(steps)));
+            const __m128 wraps = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(frame, frames)));
+            _mm_storeu_ps(p.frame+i, _mm_sub_ps(frame, _mm_mul_ps(wraps, frames)));
+        }
+    }
+
+    return numDead + integrateScalar(p, i, end, k, dead+numDead);
+}
+
+__attribute__((target("avx2")))
+size_t integrateAVX2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    const __m256 dt      = _mm256_set1_ps(k.dt);
+    const __m256 rot     = _mm256_set1_ps(k.torque * k.dt);
+    const __m256 forceX  = _mm256_set1_ps(k.forceX);
+    const __m256 forceY  = _mm256_set1_ps(k.forceY);
+    const __m256 startR  = _mm256_set1_ps(k.startR);
+    const __m256 startG  = _mm256_set1_ps(k.startG);
+    const __m256 startB  = _mm256_set1_ps(k.startB);
+    const __m256 endR    = _mm256_set1_ps(k.endR);
+    const __m256 endG    = _mm256_set1_ps(k.endG);
+    const __m256 endB    = _mm256_set1_ps(k.endB);
+    const __m256 one     = _mm256_set1_ps(1.f);
+    const __m256 alpha   = _mm256_set1_ps(255.f);
+    const __m256 zero    = _mm256_setzero_ps();
+    const __m256 frames  = _mm256_set1_ps(k.frames);
+    const __m256 perLife = _mm256_set1_ps(k.framesPerLife);
+    const __m256 perSec  = _mm256_set1_ps(k.framesPerSecond);
+    const bool animated  = k.frames > 1;
+
+    size_t numDead = 0;
+    size_t i = begin;
+
+    for(; i+8 <= end; i+=8)
+    {
+        const __m256 life = _mm256_sub_ps(_mm256_loadu_ps(p.life+i), dt);
+        _mm256_storeu_ps(p.life+i, life);
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(life, zero, _CMP_LE_OQ));
+        while(mask) {
+            dead[numDead++] = i + __builtin_ctz(mask);
+            mask &= mask-1;
+        }
+
+        _mm256_storeu_ps(p.rotation+i, _mm256_add_ps(_mm256_loadu_ps(p.rotation+i), rot));
+
+        const __m256 velX = _mm256_add_ps(_mm256_loadu_ps(p.velX+i), forceX);
+        const __m256 velY = _mm256_add_ps(_mm256_loadu_ps(p.velY+i), forceY);
+        _mm256_storeu_ps(p.velX+i, velX);
+        _mm256_storeu_ps(p.velY+i, velY);
+        _mm256_storeu_ps(p.posX+i, _mm256_add_ps(_mm256_loadu_ps(p.posX+i), _mm256_mul_ps(velX, dt)));
+        _mm256_storeu_ps(p.posY+i, _mm256_add_ps(_mm256_loadu_ps(p.posY+i), _mm256_mul_ps(velY, dt)));
+
+        const __m256 lifetime = _mm256_loadu_ps(p.lifetime+i);
+        const __m256 ratio = _mm256_div_ps(life, lifetime);
+        const __m256 inv   = _mm256_sub_ps(one, ratio);
+
+        const __m256i r = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(inv, endR), _mm256_mul_ps(ratio, startR)));
+        const __m256i g = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(inv, endG), _mm256_mul_ps(ratio, startG)));
+        const __m256i b = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(inv, endB), _mm256_mul_ps(ratio, startB)));
+        const __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(ratio, alpha));
+
+        const __m256i rgba = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                                             _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(a, 24)));
+        _mm256_storeu_si256((__m256i*)(p.color+i), rgba);
+
+        if(animated) {
+            const __m256 age   = _mm256_sub_ps(lifetime, life);
+            const __m256 steps = _mm256_add_ps(_mm256_mul_ps(inv, perLife), _mm256_mul_ps(age, perSec));
+            const __m256 frame = _mm256_add_ps(_mm256_loadu_ps(p.frameStart+i), _mm256_cvtepi32_ps(_mm256_cvttps_epi32(steps)));
+            const __m256 wraps = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_div_ps(frame, frames)));
+            _mm256_storeu_ps(p.frame+i, _mm256_sub_ps(frame, _mm256_mul_ps(wraps, frames)));
+        }
+    }
+
+    // clear the upper halves before any SSE code runs, GCC only does this
+    // on its own when optimizing and the transition stalls are expensive
+    _mm256_zeroupper();
+
+    return numDead + integrateSSE2(p, i, end, k, dead+numDead);
+}
+
+#else
+
+size_t integrateSSE2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    return integrateScalar(p, begin, end, k, dead);
+}
+
+size_t integrateAVX2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead)
+{
+    return integrateScalar(p, begin, end, k, dead);
+}
+
+#endif
+
+}
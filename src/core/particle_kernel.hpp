@@ -0,0 +1,67 @@
+#pragma once
+
+#include "particle_data.hpp"
+
+namespace particle_kernel
+{
+    enum Isa
+    {
+        ISA_SCALAR = 0,
+        ISA_SSE2,
+        ISA_AVX2
+    };
+
+    // Per-update constants shared by every particle of an emitter
+    struct Params
+    {
+        float dt;
+        float torque;
+        float forceX, forceY;
+        float startR, startG, startB;
+        float endR, endG, endB;
+
+        // Flipbook frames, the kernels leave the frame streams alone below
+        // two. A particle shows frame (start + trunc(age/lifetime *
+        // framesPerLife + age * framesPerSecond)) mod frames.
+        float frames;
+        float framesPerLife;
+        float framesPerSecond;
+    };
+
+    // Axis aligned box, empty while min > max
+    struct Bounds
+    {
+        float minX, minY;
+        float maxX, maxY;
+    };
+
+    // Best instruction set supported by this CPU
+    Isa detect();
+
+    // Instruction set used by integrate(), defaults to detect()
+    Isa getIsa();
+    void setIsa(Isa isa);
+
+    const char* getIsaName(Isa isa);
+
+    // Integrate one particle without aging it (used after a respawn)
+    void integrateParticle(ParticleData& p, size_t index, const Params& k);
+
+    // Age and integrate particles [begin, end). Indices of particles whose life
+    // ran out are written to dead (ascending) and counted in the return value;
+    // their other streams are unspecified and must be respawned by the caller.
+    size_t integrate(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead);
+
+    // Box around particles [begin, end), each one grown by its size times
+    // `extent` on every side. Empty for an empty range.
+    Bounds bounds(const ParticleData& p, size_t begin, size_t end, float extent);
+
+    // Reference implementation, every other path must match it exactly for
+    // living particles (same operation order, no fused multiply-add, colour
+    // channels and frames truncated like static_cast).
+    size_t integrateScalar(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead);
+
+    size_t integrateSSE2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead);
+
+    size_t integrateAVX2(ParticleData& p, size_t begin, size_t end, const Params& k, u32* dead);
+}
@@ -0,0 +1,133 @@
+#include "particle_vertices.hpp"
+#include "vec2.hpp"
+
+namespace particle_vertices
+{
+
+void buildReference(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out)
+{
+    for(size_t i=begin; i<end; ++i)
+    {
+        const sf::Vector2f position(p.posX[i], p.posY[i]);
+        const float size = p.size[i];
+        const float rotation = p.rotation[i];
+        sf::Vertex* v = out + i*4;
+
+        v[0].position = position + vec2::rotate(sf::Vector2f(-size,-size), rotation);
+        v[1].position = position + vec2::rotate(sf::Vector2f(-size, size), rotation);
+        v[2].position = position + vec2::rotate(sf::Vector2f( size, size), rotation);
+        v[3].position = position + vec2::rotate(sf::Vector2f( size,-size), rotation);
+
+        v[0].color = p.color[i];
+        v[1].color = p.color[i];
+        v[2].color = p.color[i];
+        v[3].color = p.color[i];
+    }
+}
+
+bool buildRotated(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out)
+{
+    bool rotated = false;
+
+    for(size_t i=begin; i<end; ++i)
+    {
+        const float x = p.posX[i];
+        const float y = p.posY[i];
+        const float rotation = p.rotation[i];
+
+        // same basis vec2::rotate builds, scaled by the half size:
+        // a = size*cos, b = size*sin, corner (sx,sy) -> (sx*a - sy*b, sx*b + sy*a)
+        const float rad = DEG2RAD * rotation;
+        const float a = p.size[i] * cos(rad);
+        const float b = p.size[i] * sin(rad);
+        sf::Vertex* v = out + i*4;
+
+        v[0].position = sf::Vector2f(x + (-a + b), y + (-b - a));
+        v[1].position = sf::Vector2f(x + (-a - b), y + (-b + a));
+        v[2].position = sf::Vector2f(x + ( a - b), y + ( b + a));
+        v[3].position = sf::Vector2f(x + ( a + b), y + ( b - a));
+
+        v[0].color = p.color[i];
+        v[1].color = p.color[i];
+        v[2].color = p.color[i];
+        v[3].color = p.color[i];
+
+        rotated |= rotation != 0;
+    }
+
+    return rotated;
+}
+
+void buildAxisAligned(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out)
+{
+    for(size_t i=begin; i<end; ++i)
+    {
+        const float x = p.posX[i];
+        const float y = p.posY[i];
+        const float size = p.size[i];
+        sf::Vertex* v = out + i*4;
+
+        v[0].position = sf::Vector2f(x - size, y - size);
+        v[1].position = sf::Vector2f(x - size, y + size);
+        v[2].position = sf::Vector2f(x + size, y + size);
+        v[3].position = sf::Vector2f(x + size, y - size);
+
+        v[0].color = p.color[i];
+        v[1].color = p.color[i];
+        v[2].color = p.color[i];
+        v[3].color = p.color[i];
+    }
+}
+
+void buildPoints(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out)
+{
+    for(size_t i=begin; i<end; ++i)
+    {
+        out[i].position  = sf::Vector2f(p.posX[i], p.posY[i]);
+        out[i].color     = p.color[i];
+        out[i].texCoords = sf::Vector2f(p.size[i], p.rotation[i]);
+    }
+}
+
+void expandPoints(const sf::Vertex* points, size_t begin, size_t end, sf::Vertex* out)
+{
+    for(size_t i=begin; i<end; ++i)
+    {
+        const float x = points[i].position.x;
+        const float y = points[i].position.y;
+        const float size = points[i].texCoords.x;
+
+        const float rad = DEG2RAD * points[i].texCoords.y;
+        const float a = size * cos(rad);
+        const float b = size * sin(rad);
+        sf::Vertex* v = out + i*4;
+
+        v[0].position = sf::Vector2f(x + (-a + b), y + (-b - a));
+        v[1].position = sf::Vector2f(x + (-a - b), y + (-b + a));
+        v[2].position = sf::Vector2f(x + ( a - b), y + ( b + a));
+        v[3].position = sf::Vector2f(x + ( a + b), y + ( b - a));
+
+        v[0].color = points[i].color;
+        v[1].color = points[i].color;
+        v[2].color = points[i].color;
+        v[3].color = points[i].color;
+    }
+}
+
+void buildFrameTexCoords(const ParticleData& p, size_t begin, size_t end, const FrameGrid& grid, sf::Vertex* out)
+{
+    for(size_t i=begin; i<end; ++i)
+    {
+        const u32 frame = static_cast<u32>(p.frame[i]);
+        const float left = grid.left + (frame % grid.columns) * grid.width;
+        const float top  = grid.top + (frame / grid.columns) * grid.height;
+        sf::Vertex* v = out + i*4;
+
+        v[0].texCoords = sf::Vector2f(left, top);
+        v[1].texCoords = sf::Vector2f(left, top + grid.height);
+        v[2].texCoords = sf::Vector2f(left + grid.width, top + grid.height);
+        v[3].texCoords = sf::Vector2f(left + grid.width, top);
+    }
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <SFML/Graphics/Vertex.hpp>
+
+#include "particle_data.hpp"
+
+// Quad expansion of particles [begin, end) into out[begin*4, end*4). Only
+// positions and colours are written, texture coordinates are left alone.
+namespace particle_vertices
+{
+    // Previous path, one vec2::rotate (a sin/cos pair) per corner
+    void buildReference(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out);
+
+    // One sin/cos pair per particle shared by all four corners. Returns
+    // whether any particle in the range is rotated at all.
+    bool buildRotated(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out);
+
+    // Corners are plain offsets, only valid when no particle is rotated
+    void buildAxisAligned(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out);
+
+    // One compact record per particle into out[begin, end) for the shader
+    // path. It is laid out as an sf::Vertex so it can be drawn as a point:
+    // position is the centre, texCoords carries (half size, rotation).
+    void buildPoints(const ParticleData& p, size_t begin, size_t end, sf::Vertex* out);
+
+    // Expand point records [begin, end) into quads the way the particle
+    // shader does, must match buildRotated() exactly
+    void expandPoints(const sf::Vertex* points, size_t begin, size_t end, sf::Vertex* out);
+
+    // Flipbook cells in texture pixels, frame n is in column n % columns
+    // and row n / columns
+    struct FrameGrid
+    {
+        float left, top;
+        float width, height;    // of one cell
+        u32 columns;
+    };
+
+    // Quad texture coordinates of the cell showing each particle's frame
+    void buildFrameTexCoords(const ParticleData& p, size_t begin, size_t end, const FrameGrid& grid, sf::Vertex* out);
+}
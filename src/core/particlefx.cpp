@@ -1,8 +1,41 @@
 #include "particlefx.hpp"
+
+#include <SFML/OpenGL.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+#include "particle_kernel.hpp"
+#include "particle_vertices.hpp"
+#include "jobs.hpp"
 #include "vec2.hpp"
+#include "random.hpp"
 #include "hsl.hpp"
 
-ParticleEmitter::ParticleEmitter(size_t count)
+namespace
+{
+    // A copy of `v` with room for `n` elements in `grown`, left empty when
+    // `v` already has the room. Throws std::bad_alloc.
+    template<class T> void growInto(const mem::Vector<T>& v, size_t n, mem::Vector<T>& grown)
+    {
+        if(n <= v.capacity())
+            return;
+
+        grown.reserve(n);
+        grown.assign(v.begin(), v.end());
+    }
+
+    // Size `v` to `n` with the buffer from growInto(), never allocates
+    template<class T> void commitGrow(mem::Vector<T>& v, size_t n, mem::Vector<T>& grown)
+    {
+        if(grown.capacity() > 0)
+            v.swap(grown);
+        v.resize(n);
+    }
+}
+
+ParticleEmitter::ParticleEmitter(size_t count, Allocator& allocator)
     : count(count),
       emitter(0, 0),
       offset(0, 0),
@@ -19,68 +52,398 @@ ParticleEmitter::ParticleEmitter(size_t count)
       maxSpeed(60),
       minSize(5),
       maxSize(20),
-      particles(count),
-      vertices(sf::Quads, count*4),
-      texture(nullptr)
+      seed(0),
+      rate(0),
+      burst(0),
+      frameColumns(1),
+      frameRows(1),
+      frameCount(0),
+      frameRate(0),
+      randomStartFrame(false),
+      cullDelay(0),
+      particles(allocator),
+      alive(0),
+      pending(0),
+      emission(0),
+      dead(allocator),
+      deadCounts(allocator),
+      randoms(allocator),
+      frame(0),
+      chunkBounds(allocator),
+      invisibleUpdates(0),
+      verticesStale(false),
+      rotating(false),
+      dirty(DIRTY_TEXCOORDS),
+      vertices(allocator),
+      points(allocator),
+      texture(nullptr),
+      shader(nullptr)
 {
+    resize(count);
 }
 ParticleEmitter::~ParticleEmitter() {}
 
-void ParticleEmitter::resize(size_t count)
+bool ParticleEmitter::resize(size_t count)
 {
+    ALLOC_SITE();
+
+    const size_t numChunks = (count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+
+    // grow every buffer into a new one before changing any of them, so
+    // running out of memory half way frees what was taken and leaves the
+    // emitter as it was
+    mem::Vector<u32> newDead(dead.get_allocator());
+    mem::Vector<size_t> newDeadCounts(deadCounts.get_allocator());
+    mem::Vector<particle_kernel::Bounds> newChunkBounds(chunkBounds.get_allocator());
+    mem::Vector<float> newRandoms(randoms.get_allocator());
+    mem::Vector<sf::Vertex> newVertices(vertices.get_allocator());
+    mem::Vector<sf::Vertex> newPoints(points.get_allocator());
+
+    try {
+        growInto(dead, count, newDead);
+        growInto(deadCounts, numChunks, newDeadCounts);
+        growInto(chunkBounds, numChunks, newChunkBounds);
+        growInto(randoms, count*PARTICLE_SPAWN_RANDOMS, newRandoms);
+        growInto(vertices, count*4, newVertices);
+        if(shader)
+            growInto(points, count, newPoints);
+    }
+    catch(const std::bad_alloc&) {
+        this->count = particles.count;
+        return false;
+    }
+
+    if(!particles.resize(count)) {
+        this->count = particles.count;
+        return false;
+    }
+
+    // nothing below allocates
     this->count = count;
-    particles.resize(count);
-    vertices.resize(count*4);
+    commitGrow(dead, count, newDead);
+    commitGrow(deadCounts, numChunks, newDeadCounts);
+    commitGrow(chunkBounds, numChunks, newChunkBounds);
+    commitGrow(randoms, count*PARTICLE_SPAWN_RANDOMS, newRandoms);
+    commitGrow(vertices, count*4, newVertices);
+    if(shader)
+        commitGrow(points, count, newPoints);
+
+    if(alive > count)
+        alive = count;
+
+    // new quads have no texture coordinates yet
+    dirty |= DIRTY_TEXCOORDS;
+    updateTexCoords();
+    return true;
 }
 
 void ParticleEmitter::resetAll()
 {
-    for(size_t i=0; i<particles.size(); ++i)
-        resetParticle(i);
+    // restart the random sequence so every reset replays the same run
+    frame = 0;
+    alive = 0;
+    pending = 0;
+    emission = 0;
+
+    spawn(rate > 0 ? burst : particles.count, Random::hash(seed, frame++));
+    updateBounds(0, alive);
+
+    // fresh particles all start unrotated
+    rotating = false;
+    buildVertices();
+}
+
+void ParticleEmitter::emit(size_t num)
+{
+    pending += num;
+}
+
+void ParticleEmitter::markVisible()
+{
+    invisibleUpdates = 0;
+
+    if(verticesStale)
+        buildVertices();
+}
+
+Particle ParticleEmitter::getParticle(size_t index) const
+{
+    Particle p;
+    p.color    = particles.color[index];
+    p.velocity = sf::Vector2f(particles.velX[index], particles.velY[index]);
+    p.position = sf::Vector2f(particles.posX[index], particles.posY[index]);
+    p.size     = particles.size[index];
+    p.rotation = particles.rotation[index];
+    p.lifetime = particles.lifetime[index];
+    p.life     = particles.life[index];
+    return p;
 }
 
 void ParticleEmitter::setTexture(sf::Texture* texture)
 {
+    // the same texture can be reloaded with another size in place
+    const sf::Vector2u size = texture ? texture->getSize() : sf::Vector2u();
+    setTexture(texture, sf::IntRect(0, 0, size.x, size.y));
+}
+
+void ParticleEmitter::setTexture(sf::Texture* texture, const sf::IntRect& rect)
+{
+    if(texture != this->texture || rect != textureRect)
+        dirty |= DIRTY_TEXCOORDS;
+
+    const bool usedPoints = usesPoints();
+
     this->texture = texture;
-    const float tw = texture->getSize().x;
-    const float th = texture->getSize().y;
+    textureRect = rect;
+
+    updateTexCoords();
+
+    // gaining or losing the texture switches between points and quads
+    if(usesPoints() != usedPoints)
+        buildVertices();
+}
+
+u32 ParticleEmitter::getFrameCount() const
+{
+    const u32 cells = std::max(frameColumns, 1u) * std::max(frameRows, 1u);
+    return frameCount > 0 ? std::min(frameCount, cells) : cells;
+}
+
+particle_vertices::FrameGrid ParticleEmitter::getFrameGrid() const
+{
+    particle_vertices::FrameGrid grid;
+    grid.columns = std::max(frameColumns, 1u);
+    grid.left    = textureRect.left;
+    grid.top     = textureRect.top;
+    grid.width   = float(textureRect.width) / grid.columns;
+    grid.height  = float(textureRect.height) / std::max(frameRows, 1u);
+    return grid;
+}
+
+sf::FloatRect ParticleEmitter::getNormalizedTextureRect() const
+{
+    const sf::Vector2u size = texture ? texture->getSize() : sf::Vector2u();
+    if(size.x == 0 || size.y == 0)
+        return sf::FloatRect(0, 0, 1, 1);
+
+    return sf::FloatRect(float(textureRect.left) / size.x, float(textureRect.top) / size.y,
+                         float(textureRect.width) / size.x, float(textureRect.height) / size.y);
+}
+
+void ParticleEmitter::setShader(sf::Shader* shader)
+{
+    this->shader = shader && sf::Shader::isAvailable() ? shader : nullptr;
+
+    // the compact stream only exists while it's used
+    points.resize(this->shader ? particles.count : 0);
+    buildVertices();
+}
+
+void ParticleEmitter::updateTexCoords()
+{
+    if(!(dirty & DIRTY_TEXCOORDS) || texture == nullptr)
+        return;
+
+    const float left   = textureRect.left;
+    const float top    = textureRect.top;
+    const float right  = left + textureRect.width;
+    const float bottom = top + textureRect.height;
 
     size_t vidx;
-    for(size_t i=0; i<particles.size(); ++i) {
+    for(size_t i=0; i<particles.count; ++i) {
         vidx = i*4;
-        vertices[vidx+0].texCoords = sf::Vector2f(0, 0);
-        vertices[vidx+1].texCoords = sf::Vector2f(0, th);
-        vertices[vidx+2].texCoords = sf::Vector2f(tw, th);
-        vertices[vidx+3].texCoords = sf::Vector2f(tw, 0);
+        vertices[vidx+0].texCoords = sf::Vector2f(left, top);
+        vertices[vidx+1].texCoords = sf::Vector2f(left, bottom);
+        vertices[vidx+2].texCoords = sf::Vector2f(right, bottom);
+        vertices[vidx+3].texCoords = sf::Vector2f(right, top);
     }
+
+    dirty &= ~DIRTY_TEXCOORDS;
+}
+
+particle_kernel::Params ParticleEmitter::getParams(const sf::Time& elapsed) const
+{
+    particle_kernel::Params k;
+    k.dt     = elapsed.asSeconds();
+    k.torque = torque;
+    k.forceX = force.x;
+    k.forceY = force.y;
+    k.startR = startColor.r; k.startG = startColor.g; k.startB = startColor.b;
+    k.endR   = endColor.r;   k.endG   = endColor.g;   k.endB   = endColor.b;
+
+    const u32 frames = getFrameCount();
+    k.frames          = frames;
+    k.framesPerLife   = frameRate > 0 ? 0 : frames;
+    k.framesPerSecond = frameRate;
+    return k;
 }
 
 void ParticleEmitter::update(const sf::Time& elapsed)
 {
-    for(size_t i=0; i<particles.size(); ++i)
-    {
-        // update the particle lifetime
-        Particle& p = particles[i];
-        p.life -= elapsed.asSeconds();
-
-        // if the particle is dead, respawn it
-        if (p.life <= 0)
-            resetParticle(i);
-
-        p.rotation += torque * elapsed.asSeconds();
-        p.velocity += force;
-        p.position += p.velocity * elapsed.asSeconds();
-
-        // update the alpha (transparency) of the particle according to its lifetime
-        float ratio = p.life / p.lifetime;
-        p.color.r = static_cast<sf::Uint8>((1-ratio)*endColor.r + ratio*startColor.r);
-        p.color.g = static_cast<sf::Uint8>((1-ratio)*endColor.g + ratio*startColor.g);
-        p.color.b = static_cast<sf::Uint8>((1-ratio)*endColor.b + ratio*startColor.b);
-        p.color.a = static_cast<sf::Uint8>(ratio * 255);
-
-        // update particle
-        updateVertices(i);
+    const particle_kernel::Params k = getParams(elapsed);
+    sf::Clock clock;
+
+    JobSystem& jobs = JobSystem::get();
+    const size_t numChunks = (alive + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+
+    // age and integrate the living particles, each chunk collects its dead
+    // ones into its own slice of the dead list
+    jobs.parallelFor(alive, PARTICLE_CHUNK, [this, &k](size_t begin, size_t end, size_t chunk) {
+        deadCounts[chunk] = particle_kernel::integrate(particles, begin, end, k, dead.data() + begin);
+
+        // the chunk is still in cache, the dead ones only make it larger
+        chunkBounds[chunk] = particle_kernel::bounds(particles, begin, end, PARTICLE_EXTENT);
+    });
+
+    stats.integrate += clock.restart();
+
+    compact(numChunks);
+
+    // without a rate every dead particle is replaced straight away
+    size_t numSpawn = pending;
+    if(rate > 0) {
+        emission += rate * k.dt;
+        numSpawn += static_cast<size_t>(emission);
+        emission -= static_cast<size_t>(emission);
+    } else {
+        numSpawn += particles.count - alive;
+    }
+    pending = 0;
+
+    const size_t spawned = alive;
+    spawn(numSpawn, Random::hash(seed, frame++));
+
+    stats.respawn += clock.restart();
+    stats.spawned += alive - spawned;
+
+    updateBounds(numChunks, alive - spawned);
+
+    if(torque != 0)
+        rotating = true;
+
+    // the renderer marks the emitter each frame it is seen, after a while
+    // without that the vertices are left for markVisible() to build
+    if(cullDelay == 0 || invisibleUpdates < cullDelay)
+        buildVertices();
+    else
+        verticesStale = true;
+
+    if(invisibleUpdates < cullDelay)
+        ++invisibleUpdates;
+
+    stats.vertices += clock.restart();
+    stats.particles += alive;
+    stats.updates++;
+}
+
+void ParticleEmitter::buildVertices()
+{
+    verticesStale = false;
+
+    if(alive == 0)
+        return;
+
+    // the shader expands the corners itself
+    if(usesPoints()) {
+        sf::Vertex* out = points.data();
+        JobSystem::get().parallelFor(alive, PARTICLE_CHUNK, [this, out](size_t begin, size_t end, size_t chunk) {
+            particle_vertices::buildPoints(particles, begin, end, out);
+        });
+        return;
+    }
+
+    sf::Vertex* out = vertices.data();
+
+    // a flipbook picks each quad's cell here, in place, otherwise the
+    // coordinates only change with the texture
+    const bool animated = isAnimated();
+    const particle_vertices::FrameGrid grid = getFrameGrid();
+    if(animated)
+        dirty |= DIRTY_TEXCOORDS;
+    else
+        updateTexCoords();
+
+    // skip the trig entirely until some particle has actually turned
+    if(!rotating) {
+        JobSystem::get().parallelFor(alive, PARTICLE_CHUNK, [this, out, animated, &grid](size_t begin, size_t end, size_t chunk) {
+            particle_vertices::buildAxisAligned(particles, begin, end, out);
+            if(animated)
+                particle_vertices::buildFrameTexCoords(particles, begin, end, grid, out);
+        });
+        return;
     }
+
+    // once torque is gone, go back to the cheap path when the last rotated
+    // particle has died
+    std::atomic<bool> rotated(false);
+    JobSystem::get().parallelFor(alive, PARTICLE_CHUNK, [this, out, animated, &grid, &rotated](size_t begin, size_t end, size_t chunk) {
+        if(particle_vertices::buildRotated(particles, begin, end, out))
+            rotated = true;
+        if(animated)
+            particle_vertices::buildFrameTexCoords(particles, begin, end, grid, out);
+    });
+    rotating = rotated || torque != 0;
+}
+
+void ParticleEmitter::updateBounds(size_t numChunks, size_t numSpawned)
+{
+    particle_kernel::Bounds b;
+    b.minX = b.minY =  INFINITY;
+    b.maxX = b.maxY = -INFINITY;
+
+    // survivors were all integrated, only moved within the range
+    for(size_t c=0; c<numChunks; ++c) {
+        b.minX = std::min(b.minX, chunkBounds[c].minX);
+        b.minY = std::min(b.minY, chunkBounds[c].minY);
+        b.maxX = std::max(b.maxX, chunkBounds[c].maxX);
+        b.maxY = std::max(b.maxY, chunkBounds[c].maxY);
+    }
+
+    // new particles all sit on the spawn point
+    if(numSpawned > 0) {
+        const sf::Vector2f spawn = emitter + offset;
+        const float r = std::max(minSize, maxSize) * PARTICLE_EXTENT;
+        b.minX = std::min(b.minX, spawn.x - r);
+        b.minY = std::min(b.minY, spawn.y - r);
+        b.maxX = std::max(b.maxX, spawn.x + r);
+        b.maxY = std::max(b.maxY, spawn.y + r);
+    }
+
+    if(alive == 0 || b.minX > b.maxX)
+        bounds = sf::FloatRect();
+    else
+        bounds = sf::FloatRect(b.minX, b.minY, b.maxX - b.minX, b.maxY - b.minY);
+}
+
+void ParticleEmitter::compact(size_t numChunks)
+{
+    // swap-remove from the back; the last living particle can't be dead
+    // since every higher dead index has been removed already
+    for(size_t c=numChunks; c-- > 0;) {
+        const u32* chunkDead = dead.data() + c*PARTICLE_CHUNK;
+        for(size_t i=deadCounts[c]; i-- > 0;) {
+            --alive;
+            if(chunkDead[i] != alive)
+                particles.move(alive, chunkDead[i]);
+        }
+    }
+}
+
+void ParticleEmitter::spawn(size_t num, u64 frameSeed)
+{
+    const size_t first = alive;
+    num = std::min(num, particles.count - alive);
+    alive += num;
+
+    // every chunk draws from its own stream, derived from the seed, the frame
+    // and the chunk index only, so spawns don't depend on scheduling
+    JobSystem::get().parallelFor(num, PARTICLE_CHUNK, [this, first, frameSeed](size_t begin, size_t end, size_t chunk) {
+        float* random = randoms.data() + (first+begin)*PARTICLE_SPAWN_RANDOMS;
+        Random(Random::hash(frameSeed, chunk)).fill(random, (end-begin)*PARTICLE_SPAWN_RANDOMS);
+
+        for(size_t i=begin; i<end; ++i)
+            resetParticle(first+i, randoms.data() + (first+i)*PARTICLE_SPAWN_RANDOMS);
+    });
 }
 
 void ParticleEmitter::draw(sf::RenderTarget& target, sf::RenderStates states) const
@@ -89,49 +452,63 @@ void ParticleEmitter::draw(sf::RenderTarget& target, sf::RenderStates states) co
     states.transform *= getTransform();
     states.texture = texture;
 
-    target.draw(vertices, states);
-}
+    // only the living prefix is submitted
+    if(alive == 0)
+        return;
 
-void ParticleEmitter::updateVertices(size_t index)
-{
-    Particle& p = particles[index];
-    size_t vidx = index*4;
+    if(usesPoints()) {
+        preparePointShader(*shader, target, getNormalizedTextureRect());
+        states.shader = shader;
+    }
 
-    // update the position and color of vertices
-    vertices[vidx+0].position = p.position + vec2::rotate(sf::Vector2f(-p.size,-p.size), p.rotation);
-    vertices[vidx+1].position = p.position + vec2::rotate(sf::Vector2f(-p.size, p.size), p.rotation);
-    vertices[vidx+2].position = p.position + vec2::rotate(sf::Vector2f( p.size, p.size), p.rotation);
-    vertices[vidx+3].position = p.position + vec2::rotate(sf::Vector2f( p.size,-p.size), p.rotation);
+    target.draw(getVertices(), getVertexCount(), getPrimitiveType(), states);
 
-    vertices[vidx+0].color = p.color;
-    vertices[vidx+1].color = p.color;
-    vertices[vidx+2].color = p.color;
-    vertices[vidx+3].color = p.color;
+    if(usesPoints())
+        finishPointShader();
 }
 
-void ParticleEmitter::resetParticle(size_t index)
+void ParticleEmitter::preparePointShader(sf::Shader& shader, const sf::RenderTarget& target, const sf::FloatRect& texRect)
 {
-    // give a random velocity and lifetime to the particle
-    float random = ((float)rand()) / (float)RAND_MAX;
-    float lifetime = minLife + (random * (maxLife-minLife));
+    // world units to pixels, assuming an unrotated, uniformly scaled view
+    const sf::View& view = target.getView();
+    const float scale = target.getViewport(view).height / view.getSize().y;
 
-    random = ((float)rand()) / (float)RAND_MAX;
-    float speed = minSpeed + (random * (maxSpeed-minSpeed));
+    shader.setParameter("scale", scale);
+    shader.setParameter("texRect", texRect.left, texRect.top, texRect.width, texRect.height);
+    shader.setParameter("texture", sf::Shader::CurrentTexture);
 
-    random = ((float)rand()) / (float)RAND_MAX;
-    float size = minSize + (random * (maxSize-minSize));
+    // let the vertex shader size the points and give them coordinates
+    glEnable(0x8642); // GL_VERTEX_PROGRAM_POINT_SIZE
+    glEnable(0x8861); // GL_POINT_SPRITE
+}
 
-    random = ((float)rand()) / (float)RAND_MAX;
-    float angle = (minAngle + (random * (maxAngle-minAngle))) * DEG2RAD;
+void ParticleEmitter::finishPointShader()
+{
+    glDisable(0x8642);
+    glDisable(0x8861);
+}
+
+void ParticleEmitter::resetParticle(size_t index, const float* random)
+{
+    // give a random velocity and lifetime to the particle
+    float lifetime = minLife + (random[0] * (maxLife-minLife));
+    float speed = minSpeed + (random[1] * (maxSpeed-minSpeed));
+    float size = minSize + (random[2] * (maxSize-minSize));
+    float angle = (minAngle + (random[3] * (maxAngle-minAngle))) * DEG2RAD;
 
-    Particle& p = particles[index];
-    p.color = startColor;
-    p.velocity = sf::Vector2f(cos(angle) * speed, sin(angle) * speed);
-    p.position = emitter + offset;
-    p.size = size;
-    p.rotation = 0;
-    p.lifetime = lifetime;
-    p.life = lifetime;
+    ParticleData& p = particles;
+    p.color[index] = startColor;
+    p.velX[index] = cos(angle) * speed;
+    p.velY[index] = sin(angle) * speed;
+    p.posX[index] = emitter.x + offset.x;
+    p.posY[index] = emitter.y + offset.y;
+    p.size[index] = size;
+    p.rotation[index] = 0;
+    p.lifetime[index] = lifetime;
+    p.life[index] = lifetime;
 
-    updateVertices(index);
+    // random is below 1, so the start stays below the frame count
+    const float start = randomStartFrame ? static_cast<int>(random[4] * getFrameCount()) : 0;
+    p.frameStart[index] = start;
+    p.frame[index] = start;
 }
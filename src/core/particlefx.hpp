@@ -1,8 +1,23 @@
 #pragma once
 
+#include <cstring>
+
 #include <SFML/Graphics.hpp>
 #include "cereal.hpp"
+#include "particle_data.hpp"
+#include "particle_kernel.hpp"
+#include "particle_vertices.hpp"
+
+// Particles per job when an emitter update is split across workers
+#define PARTICLE_CHUNK 8192
+
+// Uniform randoms consumed by one respawn
+#define PARTICLE_SPAWN_RANDOMS 5
 
+// Farthest quad corner from the centre in particle sizes, sqrt(2) rounded up
+#define PARTICLE_EXTENT 1.4143f
+
+// Gathered view of a single particle, the emitter itself stores them as SoA
 struct Particle
 {
     sf::Color color;
@@ -14,12 +29,32 @@ struct Particle
     float life;
 };
 
+// Time spent in each phase of ParticleEmitter::update(), summed until reset
+struct EmitterStats
+{
+    EmitterStats() : updates(0), particles(0), spawned(0) {}
+
+    sf::Time integrate;
+    sf::Time respawn;
+    sf::Time vertices;
+
+    size_t updates;
+    size_t particles;   // living particles summed over all updates
+    size_t spawned;
+};
+
 class ParticleEmitter : public sf::Drawable, public sf::Transformable
 {
 public:
-    ParticleEmitter(size_t count = 100);
+    // Particle and vertex storage is drawn from `allocator`, which has to be
+    // able to free single blocks and must outlive the emitter
+    ParticleEmitter(size_t count = 100, Allocator& allocator = mem::getDefaultAllocator());
     ~ParticleEmitter();
 
+    // Emitters move, e.g. when a Pool compacts, but never copy
+    ParticleEmitter(ParticleEmitter&&) = default;
+    ParticleEmitter& operator=(ParticleEmitter&&) = default;
+
     size_t count;
 
     sf::Vector2f emitter;
@@ -46,31 +81,205 @@ public:
     float minSize;
     float maxSize;
 
-    void resize(size_t count);
+    // Seed of the emitter's random stream, same seed gives the same run
+    u32 seed;
+
+    // Particles spawned per second, 0 keeps the emitter full
+    float rate;
+
+    // Particles spawned at once by resetAll() when rate is set
+    u32 burst;
+
+    // Flipbook grid over the texture rectangle, frames run left to right
+    // then top to bottom. 1x1 shows the whole rectangle.
+    u32 frameColumns;
+    u32 frameRows;
+
+    // Frames used out of the grid, 0 uses every cell
+    u32 frameCount;
+
+    // Frames per second looping over the particle's life, 0 plays every
+    // frame once over its life instead
+    float frameRate;
+
+    // Start every particle on a random frame instead of the first
+    bool randomStartFrame;
+
+    // Updates after which an emitter that wasn't marked visible stops
+    // building vertices, 0 always builds them
+    u32 cullDelay;
+
+    // Keeps the previous size when the allocator is out of memory
+    bool resize(size_t count);
 
     void resetAll();
 
+    // The whole texture on every particle
     void setTexture(sf::Texture* texture);
 
+    // Only the pixels in `rect`, e.g. the region of an atlas page
+    void setTexture(sf::Texture* texture, const sf::IntRect& rect);
+
+    // Draw one point per particle expanded by this shader (particle_v/f.glsl)
+    // instead of CPU-built quads while the emitter has a texture, nullptr
+    // goes back to quads
+    void setShader(sf::Shader* shader);
+
     void update(const sf::Time& elapsed);
 
-    inline size_t getCount() const { return particles.size(); }
+    // Queue particles to spawn on the next update
+    void emit(size_t num);
+
+    // Called by the renderer when the emitter is in a view, rebuilds the
+    // vertices if updates skipped them
+    void markVisible();
+
+    // Conservative box around the living particles in local space, kept by
+    // update() and resetAll()
+    inline const sf::FloatRect& getBounds() const { return bounds; }
+
+    inline size_t getCount() const { return particles.count; }
+
+    inline size_t getAliveCount() const { return alive; }
+
+    Particle getParticle(size_t index) const;
+
+    inline const ParticleData& getParticles() const { return particles; }
+
+    // Integrator constants for a step of the given length
+    particle_kernel::Params getParams(const sf::Time& elapsed) const;
+
+    inline Allocator& getAllocator() const { return particles.getAllocator(); }
+
+    // Geometry of the living particles as built by the last update, in the
+    // emitter's local space: four quad corners per particle, or one point
+    // record per particle while a shader and a texture are set
+    inline const sf::Vertex* getVertices() const { return usesPoints() ? points.data() : vertices.data(); }
+
+    inline size_t getVertexCount() const { return usesPoints() ? alive : alive*4; }
+
+    inline sf::PrimitiveType getPrimitiveType() const { return usesPoints() ? sf::Points : sf::Quads; }
+
+    inline const sf::Texture* getTexture() const { return texture; }
+
+    inline const sf::IntRect& getTextureRect() const { return textureRect; }
+
+    // The texture rectangle in [0, 1] texture space, as the point shader
+    // takes it
+    sf::FloatRect getNormalizedTextureRect() const;
+
+    // Shader the geometry is drawn with, nullptr for quads
+    inline sf::Shader* getShader() const { return usesPoints() ? shader : nullptr; }
+
+    // Cells the flipbook plays, 1 when the emitter isn't animated
+    u32 getFrameCount() const;
+
+    inline bool isAnimated() const { return getFrameCount() > 1; }
+
+    // Set the point shader up for drawing to `target` through its current
+    // view, sampling `texRect` of the texture. This enables the GL point
+    // sprite state, call finishPointShader() once the points are drawn.
+    static void preparePointShader(sf::Shader& shader, const sf::RenderTarget& target,
+                                   const sf::FloatRect& texRect = sf::FloatRect(0, 0, 1, 1));
+
+    // Restore the GL state preparePointShader() changed, so it doesn't leak
+    // into SFML or ImGui draws
+    static void finishPointShader();
+
+    inline const EmitterStats& getStats() const { return stats; }
+
+    inline void resetStats() { stats = EmitterStats(); }
 
 private:
     virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
-    void updateVertices(size_t index);
+    void buildVertices();
+
+    void updateTexCoords();
+
+    void resetParticle(size_t index, const float* random);
+
+    void compact(size_t numChunks);
+
+    void spawn(size_t num, u64 frameSeed);
+
+    void updateBounds(size_t numChunks, size_t numSpawned);
+
+    // Living particles are packed in [0, alive)
+    ParticleData particles;
+    size_t alive;
+    size_t pending;
+    float emission;
+
+    // Sized with the particles so updates never allocate
+    mem::Vector<u32> dead;
+    mem::Vector<size_t> deadCounts;
+    mem::Vector<float> randoms;
+    u64 frame;
+
+    // Per chunk boxes from the last integration, merged into bounds
+    mem::Vector<particle_kernel::Bounds> chunkBounds;
+    sf::FloatRect bounds;
+    u32 invisibleUpdates;
+    bool verticesStale;
+
+    EmitterStats stats;
+
+    // Whether any living particle may be rotated
+    bool rotating;
 
-    void resetParticle(size_t index);
+    // Point records have no room for a frame, so flipbooks are expanded
+    // into quads on the CPU even when a shader is set. The shader always
+    // samples, untextured emitters stay quads so they aren't drawn black.
+    inline bool usesPoints() const { return shader && texture && !isAnimated(); }
 
-    std::vector<Particle> particles;
-    sf::VertexArray vertices;
+    particle_vertices::FrameGrid getFrameGrid() const;
+
+    // Parts of the vertex array that are out of date with the configuration
+    enum Dirty
+    {
+        DIRTY_TEXCOORDS = 1 << 0
+    };
+    u32 dirty;
+
+    mem::Vector<sf::Vertex> vertices;
+    mem::Vector<sf::Vertex> points;
     sf::Texture* texture;
+    sf::IntRect textureRect;
+    sf::Shader* shader;
 
     friend class cereal::access;
 
+    // Version of the serialized fields, bump it with every field added to
+    // serializeFields() and add the field to particle_binary::Effect too
+    static const std::uint32_t SERIAL_VERSION = 3;
+
+    // Every emitter carries its own version, unlike cereal's class versions,
+    // which are only written with the first emitter of an archive and would
+    // make the ones after it look unversioned. An emitter without one was
+    // saved before the fields were versioned and loads as version 0. Only
+    // archives with named nodes (JSON) can tell.
+    template <class Archive>
+    void save(Archive& ar) const
+    {
+        std::uint32_t version = SERIAL_VERSION;
+        ar(cereal::make_nvp("cereal_class_version", version));
+        const_cast<ParticleEmitter*>(this)->serializeFields(ar, version);
+    }
+
     template <class Archive>
-    void serialize(Archive& ar)
+    void load(Archive& ar)
+    {
+        std::uint32_t version = 0;
+        const char* name = ar.getNodeName();
+        if(name && std::strcmp(name, "cereal_class_version") == 0)
+            ar(cereal::make_nvp("cereal_class_version", version));
+
+        serializeFields(ar, version);
+    }
+
+    template <class Archive>
+    void serializeFields(Archive& ar, const std::uint32_t version)
     {
         ar(count);
         ar(emitter.x); ar(emitter.y);
@@ -95,5 +304,21 @@ private:
         ar(maxTorque);
         ar(minSize);
         ar(maxSize);
+
+        if(version >= 1)
+            ar(seed);
+
+        if(version >= 2) {
+            ar(rate);
+            ar(burst);
+        }
+
+        if(version >= 3) {
+            ar(frameColumns);
+            ar(frameRows);
+            ar(frameCount);
+            ar(frameRate);
+            ar(randomStartFrame);
+        }
     }
 };
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <SFML/System.hpp>
 
+#include "error.hpp"
+
 using uint = unsigned int;
 
 using u8 = sf::Uint8;
@@ -13,29 +17,41 @@ using uptr = uintptr_t;
 
 namespace pointer
 {
-    inline void* alignForward(void* address, u8 alignment)
+    // Alignments have to be powers of two, checked at compile time where the
+    // alignment is a constant and by ASSERT where it's not
+    constexpr bool isPowerOfTwo(size_t x)
+    {
+        return x != 0 && (x & (x-1)) == 0;
+    }
+
+    inline void* alignForward(void* address, size_t alignment)
     {
-        return (void*)( ( reinterpret_cast<uptr>(address) + static_cast<uptr>(alignment-1) ) & static_cast<uptr>(~(alignment-1)) );
+        ASSERT(isPowerOfTwo(alignment));
+        return (void*)( ( reinterpret_cast<uptr>(address) + static_cast<uptr>(alignment-1) ) & ~static_cast<uptr>(alignment-1) );
     }
 
-    inline const void* alignForward(const void* address, u8 alignment)
+    inline const void* alignForward(const void* address, size_t alignment)
     {
-        return (void*)( ( reinterpret_cast<uptr>(address) + static_cast<uptr>(alignment-1) ) & static_cast<uptr>(~(alignment-1)) );
+        ASSERT(isPowerOfTwo(alignment));
+        return (void*)( ( reinterpret_cast<uptr>(address) + static_cast<uptr>(alignment-1) ) & ~static_cast<uptr>(alignment-1) );
     }
 
-    inline void* alignBackward(void* address, u8 alignment)
+    inline void* alignBackward(void* address, size_t alignment)
     {
-        return (void*)( reinterpret_cast<uptr>(address) & static_cast<uptr>(~(alignment-1)) );
+        ASSERT(isPowerOfTwo(alignment));
+        return (void*)( reinterpret_cast<uptr>(address) & ~static_cast<uptr>(alignment-1) );
     }
 
-    inline const void* alignBackward(const void* address, u8 alignment)
+    inline const void* alignBackward(const void* address, size_t alignment)
     {
-        return (void*)( reinterpret_cast<uptr>(address) & static_cast<uptr>(~(alignment-1)) );
+        ASSERT(isPowerOfTwo(alignment));
+        return (void*)( reinterpret_cast<uptr>(address) & ~static_cast<uptr>(alignment-1) );
     }
 
-    inline u8 alignForwardAdjustment(const void* address, u8 alignment)
+    inline size_t alignForwardAdjustment(uptr address, size_t alignment)
     {
-        u8 adjustment =  alignment - ( reinterpret_cast<uptr>(address) & static_cast<uptr>(alignment-1) );
+        ASSERT(isPowerOfTwo(alignment));
+        size_t adjustment =  alignment - ( address & static_cast<uptr>(alignment-1) );
 
         if(adjustment == alignment)
                 return 0; //already aligned
@@ -43,11 +59,18 @@ namespace pointer
         return adjustment;
     }
 
-    inline u8 alignForwardAdjustmentWithHeader(const void* address, u8 alignment, u8 headerSize)
+    inline size_t alignForwardAdjustment(const void* address, size_t alignment)
+    {
+        return alignForwardAdjustment(reinterpret_cast<uptr>(address), alignment);
+    }
+
+    // Takes the address as an integer so fresh, still uninitialized blocks
+    // can be passed without GCC assuming they are read
+    inline size_t alignForwardAdjustmentWithHeader(uptr address, size_t alignment, size_t headerSize)
     {
-        u8 adjustment =  alignForwardAdjustment(address, alignment);
+        size_t adjustment =  alignForwardAdjustment(address, alignment);
 
-        u8 neededSpace = headerSize;
+        size_t neededSpace = headerSize;
 
         if(adjustment < neededSpace)
         {
@@ -63,14 +86,15 @@ namespace pointer
         return adjustment;
     }
 
-    inline u8 alignBackwardAdjustment(const void* address, u8 alignment)
+    inline size_t alignForwardAdjustmentWithHeader(const void* address, size_t alignment, size_t headerSize)
     {
-        u8 adjustment =  reinterpret_cast<uptr>(address) & static_cast<uptr>(alignment-1);
-
-        if(adjustment == alignment)
-            return 0; //already aligned
+        return alignForwardAdjustmentWithHeader(reinterpret_cast<uptr>(address), alignment, headerSize);
+    }
 
-        return adjustment;
+    inline size_t alignBackwardAdjustment(const void* address, size_t alignment)
+    {
+        ASSERT(isPowerOfTwo(alignment));
+        return reinterpret_cast<uptr>(address) & static_cast<uptr>(alignment-1);
     }
 
     inline void* add(void* p, size_t x)
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <new>
+#include <utility>
+
+#include "alloc.hpp"
+
+/// Pool
+// Fixed capacity store of T objects addressed through 32 bit handles. Live
+// objects are kept packed in [begin(), end()) so a pass over them walks one
+// contiguous array; destroy() moves the last object into the hole, so T has
+// to be move constructible and assignable. Handles carry the generation of
+// their slot, so one kept after its object is destroyed no longer resolves.
+template<class T>
+class Pool
+{
+public:
+    static const u32    INDEX_BITS      = 20;
+    static const u32    INDEX_MASK      = (1u << INDEX_BITS) - 1;
+    static const u32    GENERATION_MASK = ~0u >> INDEX_BITS;
+    static const size_t MAX_CAPACITY    = size_t(1) << INDEX_BITS;
+
+    class Handle
+    {
+    public:
+        // The null handle, never valid in any pool
+        Handle() : id(0) {}
+
+        inline bool isNull() const { return id == 0; }
+
+        inline u32 getId() const { return id; }
+
+        // Back from getId(), for handles passed through untyped channels
+        static Handle fromId(u32 id) { Handle h; h.id = id; return h; }
+
+        inline u32 getIndex() const { return id & INDEX_MASK; }
+
+        inline u32 getGeneration() const { return id >> INDEX_BITS; }
+
+        inline bool operator==(const Handle& other) const { return id == other.id; }
+
+        inline bool operator!=(const Handle& other) const { return id != other.id; }
+
+    private:
+        friend class Pool;
+
+        Handle(u32 index, u32 generation) : id(generation << INDEX_BITS | index) {}
+
+        u32 id;
+    };
+
+    // The object, slot and dense index arrays are drawn from `allocator`,
+    // which must outlive the pool. Capacity is 0 when it is out of memory.
+    explicit Pool(size_t capacity, Allocator& allocator = mem::getDefaultAllocator())
+        : allocator(allocator), objects(nullptr), slots(nullptr), owners(nullptr),
+          capacity(0), count(0), freeSlot(INVALID)
+    {
+        ASSERT(capacity > 0 && capacity <= MAX_CAPACITY);
+
+        objects = (T*)allocator.allocate(capacity * sizeof(T), __alignof(T));
+        slots   = (Slot*)allocator.allocate(capacity * sizeof(Slot), __alignof(Slot));
+        owners  = (u32*)allocator.allocate(capacity * sizeof(u32), __alignof(u32));
+
+        if(objects == nullptr || slots == nullptr || owners == nullptr) {
+            release();
+            return;
+        }
+
+        this->capacity = capacity;
+
+        // every slot starts free, chained in index order
+        for(size_t i=0; i<capacity; ++i) {
+            slots[i].dense      = i+1 < capacity ? u32(i+1) : INVALID;
+            slots[i].generation = 1;
+        }
+        freeSlot = 0;
+    }
+
+    ~Pool()
+    {
+        clear();
+        release();
+    }
+
+    // Null handle when the pool is full
+    template<class... Args> Handle create(Args&&... args)
+    {
+        if(freeSlot == INVALID)
+            return Handle();
+
+        const u32 index = freeSlot;
+        Slot& slot = slots[index];
+
+        new (&objects[count]) T(std::forward<Args>(args)...);
+
+        freeSlot   = slot.dense;
+        slot.dense = u32(count);
+        owners[count] = index;
+        ++count;
+
+        return Handle(index, slot.generation);
+    }
+
+    void destroy(Handle handle)
+    {
+        ASSERT(isValid(handle));
+        if(!isValid(handle))
+            return;
+
+        Slot& slot = slots[handle.getIndex()];
+        const u32 dense = slot.dense;
+        const u32 last  = u32(count - 1);
+
+        // fill the hole with the last object to stay packed
+        if(dense != last) {
+            objects[dense] = std::move(objects[last]);
+            owners[dense]  = owners[last];
+            slots[owners[dense]].dense = dense;
+        }
+        objects[last].~T();
+        --count;
+
+        // outstanding handles to the slot go stale, 0 is kept for null
+        slot.generation = (slot.generation + 1) & GENERATION_MASK;
+        if(slot.generation == 0)
+            slot.generation = 1;
+
+        slot.dense = freeSlot;
+        freeSlot   = handle.getIndex();
+    }
+
+    // Destroys every object, all handles go stale
+    void clear()
+    {
+        while(count > 0)
+            destroy(getHandle(count - 1));
+    }
+
+    bool isValid(Handle handle) const
+    {
+        const u32 index = handle.getIndex();
+        return !handle.isNull() && index < capacity &&
+               slots[index].generation == handle.getGeneration() &&
+               slots[index].dense < count && owners[slots[index].dense] == index;
+    }
+
+    // nullptr for stale handles
+    inline T* get(Handle handle) { return isValid(handle) ? &objects[slots[handle.getIndex()].dense] : nullptr; }
+
+    inline const T* get(Handle handle) const { return isValid(handle) ? &objects[slots[handle.getIndex()].dense] : nullptr; }
+
+    // Unchecked outside debug builds
+    inline T& operator[](Handle handle)
+    {
+        ASSERT(isValid(handle));
+        return objects[slots[handle.getIndex()].dense];
+    }
+
+    inline const T& operator[](Handle handle) const
+    {
+        ASSERT(isValid(handle));
+        return objects[slots[handle.getIndex()].dense];
+    }
+
+    // Handle of the object at `denseIndex` in [begin(), end())
+    inline Handle getHandle(size_t denseIndex) const
+    {
+        ASSERT(denseIndex < count);
+        const u32 index = owners[denseIndex];
+        return Handle(index, slots[index].generation);
+    }
+
+    inline T* begin() { return objects; }
+    inline T* end() { return objects + count; }
+
+    inline const T* begin() const { return objects; }
+    inline const T* end() const { return objects + count; }
+
+    inline size_t size() const { return count; }
+
+    inline size_t getCapacity() const { return capacity; }
+
+    inline bool isFull() const { return freeSlot == INVALID; }
+
+private:
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+    static const u32 INVALID = ~0u;
+
+    struct Slot
+    {
+        u32 dense;       // index into objects while live, next free slot otherwise
+        u32 generation;
+    };
+
+    void release()
+    {
+        if(objects) allocator.deallocate(objects);
+        if(slots)   allocator.deallocate(slots);
+        if(owners)  allocator.deallocate(owners);
+
+        objects  = nullptr;
+        slots    = nullptr;
+        owners   = nullptr;
+        capacity = 0;
+        freeSlot = INVALID;
+    }
+
+    Allocator& allocator;
+
+    T*      objects;
+    Slot*   slots;
+    u32*    owners;     // slot of each dense object
+
+    size_t  capacity;
+    size_t  count;
+    u32     freeSlot;
+};
@@ -0,0 +1,183 @@
+#include "texture_atlas.hpp"
+
+#include <algorithm>
+
+#include "error.hpp"
+
+// imgui_draw.cpp keeps its copy static too, so the two don't clash. The
+// parts of it this file doesn't call would warn as unused.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+#define STBRP_STATIC
+#define STBRP_ASSERT(x) ASSERT(x)
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+    struct Placement
+    {
+        const std::string*  name;
+        unsigned            width;
+        unsigned            height;
+    };
+
+    bool largerFirst(const Placement& a, const Placement& b)
+    {
+        if(a.height != b.height)
+            return a.height > b.height;
+        if(a.width != b.width)
+            return a.width > b.width;
+        return *a.name < *b.name;
+    }
+
+    unsigned nextPowerOfTwo(unsigned x)
+    {
+        unsigned p = 1;
+        while(p < x)
+            p <<= 1;
+        return p;
+    }
+}
+
+/// AtlasBuilder
+AtlasBuilder::AtlasBuilder(unsigned pageSize, unsigned padding)
+    : pageSize(pageSize), padding(padding)
+{
+    // the packer works in 16 bit coordinates
+    ASSERT(pageSize > 0 && pageSize <= 0xffff);
+}
+
+void AtlasBuilder::add(const std::string& name, const sf::Image& image)
+{
+    images[name] = image;
+}
+
+bool AtlasBuilder::build()
+{
+    regions.clear();
+    pages.clear();
+
+    std::vector<Placement> order;
+    for(const auto& image : images) {
+        const sf::Vector2u size = image.second.getSize();
+        if(size.x + padding > pageSize || size.y + padding > pageSize)
+            return false;
+
+        order.push_back(Placement{&image.first, size.x, size.y});
+    }
+    std::sort(order.begin(), order.end(), largerFirst);
+
+    // stb keeps pointers into each context, so they must not move
+    std::deque<stbrp_context>           contexts;
+    std::vector<std::vector<stbrp_node>> nodes;
+    std::vector<sf::Vector2u>            extents;
+
+    for(const Placement& p : order)
+    {
+        stbrp_rect rect;
+        rect.id = 0;
+        rect.w  = p.width + padding;
+        rect.h  = p.height + padding;
+        rect.was_packed = 0;
+
+        // one rect per call, stb sorts a batch with qsort, which may order
+        // equal sizes differently on another platform
+        size_t page = 0;
+        for(; page < contexts.size(); ++page) {
+            stbrp_pack_rects(&contexts[page], &rect, 1);
+            if(rect.was_packed)
+                break;
+        }
+
+        if(page == contexts.size()) {
+            nodes.push_back(std::vector<stbrp_node>(pageSize));
+            contexts.push_back(stbrp_context());
+            stbrp_init_target(&contexts.back(), pageSize, pageSize, nodes.back().data(), pageSize);
+            extents.push_back(sf::Vector2u(1, 1));
+
+            stbrp_pack_rects(&contexts.back(), &rect, 1);
+            ASSERT(rect.was_packed);
+        }
+
+        Region& region = regions[*p.name];
+        region.page = page;
+        region.rect = sf::IntRect(rect.x, rect.y, p.width, p.height);
+
+        extents[page].x = std::max(extents[page].x, unsigned(rect.x + p.width));
+        extents[page].y = std::max(extents[page].y, unsigned(rect.y + p.height));
+    }
+
+    for(const sf::Vector2u& extent : extents) {
+        pages.push_back(sf::Image());
+        pages.back().create(nextPowerOfTwo(extent.x), nextPowerOfTwo(extent.y), sf::Color::Transparent);
+    }
+
+    for(const auto& image : images) {
+        const Region& region = regions[image.first];
+        pages[region.page].copy(image.second, region.rect.left, region.rect.top);
+    }
+
+    return true;
+}
+
+const AtlasBuilder::Region* AtlasBuilder::find(const std::string& name) const
+{
+    auto it = regions.find(name);
+    return it != regions.end() ? &it->second : nullptr;
+}
+
+
+/// TextureAtlas
+TextureAtlas::TextureAtlas()
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    clear();
+}
+
+bool TextureAtlas::upload(const AtlasBuilder& builder)
+{
+    clear();
+
+    for(size_t i=0; i<builder.getNumPages(); ++i) {
+        sf::Texture* texture = new sf::Texture();
+        pages.push_back(texture);
+
+        if(!texture->loadFromImage(builder.getPage(i))) {
+            clear();
+            return false;
+        }
+    }
+
+    regions = builder.getRegions();
+    return true;
+}
+
+void TextureAtlas::clear()
+{
+    for(auto page : pages)
+        delete page;
+    pages.clear();
+    regions.clear();
+}
+
+bool TextureAtlas::find(const std::string& name, sf::Texture*& texture, sf::IntRect& rect) const
+{
+    auto it = regions.find(name);
+    if(it == regions.end())
+        return false;
+
+    texture = pages[it->second.page];
+    rect    = it->second.rect;
+    return true;
+}
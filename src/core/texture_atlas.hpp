@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "pointer.hpp"
+
+// Largest atlas page side in pixels, pages are trimmed to the power of two
+// sizes they need
+#define ATLAS_PAGE_SIZE 1024
+
+// Transparent pixels kept right of and below every image, so filtering never
+// picks up a neighbour
+#define ATLAS_PADDING 1
+
+/// AtlasBuilder
+// Packs images onto as few pages as possible with stb_rect_pack, on the CPU
+// only. Images are placed one at a time, tallest first with ties broken by
+// width and then name, each on the first page it fits, so the layout depends
+// only on the set of images and not on the order they were added in.
+class AtlasBuilder
+{
+public:
+    // Pixel rectangle of an image on its page
+    struct Region
+    {
+        u32         page;
+        sf::IntRect rect;
+    };
+
+    explicit AtlasBuilder(unsigned pageSize = ATLAS_PAGE_SIZE, unsigned padding = ATLAS_PADDING);
+
+    // Replaces an image added under the same name
+    void add(const std::string& name, const sf::Image& image);
+
+    // False when an image doesn't fit on a page, nothing is built then
+    bool build();
+
+    inline size_t getNumPages() const { return pages.size(); }
+
+    inline const sf::Image& getPage(size_t index) const { return pages[index]; }
+
+    // nullptr when no image has that name
+    const Region* find(const std::string& name) const;
+
+    inline const std::map<std::string, Region>& getRegions() const { return regions; }
+
+private:
+    unsigned                        pageSize;
+    unsigned                        padding;
+
+    std::map<std::string, sf::Image> images;
+    std::map<std::string, Region>    regions;
+    std::deque<sf::Image>            pages;
+};
+
+/// TextureAtlas
+// The pages of an AtlasBuilder uploaded as textures, which stay at the same
+// address until the atlas is cleared
+class TextureAtlas
+{
+public:
+    TextureAtlas();
+    ~TextureAtlas();
+
+    // Must run on the thread owning the GL context
+    bool upload(const AtlasBuilder& builder);
+
+    void clear();
+
+    // False when no image has that name
+    bool find(const std::string& name, sf::Texture*& texture, sf::IntRect& rect) const;
+
+    inline size_t getNumPages() const { return pages.size(); }
+
+    inline sf::Texture& getPage(size_t index) const { return *pages[index]; }
+
+private:
+    TextureAtlas(const TextureAtlas&);
+    TextureAtlas& operator=(const TextureAtlas&);
+
+    std::vector<sf::Texture*>                   pages;
+    std::map<std::string, AtlasBuilder::Region> regions;
+};
@@ -0,0 +1,190 @@
+#include "texture_loader.hpp"
+
+/// ImageDecoder
+ImageDecoder::ImageDecoder(size_t numThreads)
+    : busy(0), running(true)
+{
+    for(size_t i=0; i<numThreads; ++i)
+        threads.emplace_back(&ImageDecoder::threadLoop, this);
+}
+
+ImageDecoder::~ImageDecoder()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+        requests.clear();
+    }
+    wakeup.notify_all();
+
+    for(auto& thread : threads)
+        thread.join();
+
+    for(auto result : results)
+        delete result;
+}
+
+void ImageDecoder::decode(u32 id, const std::string& path)
+{
+    push(Request{id, path, nullptr, 0});
+}
+
+void ImageDecoder::decode(u32 id, const void* data, size_t size)
+{
+    push(Request{id, std::string(), data, size});
+}
+
+void ImageDecoder::push(const Request& request)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.push_back(request);
+    }
+    wakeup.notify_one();
+}
+
+std::unique_ptr<ImageDecoder::Result> ImageDecoder::poll()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(results.empty())
+        return std::unique_ptr<Result>();
+
+    std::unique_ptr<Result> result(results.front());
+    results.pop_front();
+    return result;
+}
+
+void ImageDecoder::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this]() { return requests.empty() && busy == 0; });
+}
+
+size_t ImageDecoder::getPending() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return requests.size() + busy;
+}
+
+void ImageDecoder::threadLoop()
+{
+    for(;;)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeup.wait(guard, [this]() { return !running || !requests.empty(); });
+            if(!running)
+                return;
+
+            request = requests.front();
+            requests.pop_front();
+            ++busy;
+        }
+
+        // the slow part, outside the lock
+        Result* result = new Result;
+        result->id = request.id;
+        result->ok = request.data ? result->image.loadFromMemory(request.data, request.size)
+                                  : result->image.loadFromFile(request.path);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            results.push_back(result);
+            --busy;
+        }
+        idle.notify_all();
+    }
+}
+
+
+/// TextureLoader
+TextureLoader::TextureLoader(size_t capacity, size_t numThreads, Allocator& allocator)
+    : entries(capacity, allocator),
+      decoder(numThreads)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+    for(auto& entry : entries)
+        delete entry.texture;
+}
+
+TextureLoader::Handle TextureLoader::load(const std::string& path)
+{
+    const Handle handle = entries.create(Entry{nullptr, false});
+    if(!handle.isNull())
+        decoder.decode(handle.getId(), path);
+    return handle;
+}
+
+TextureLoader::Handle TextureLoader::load(const void* data, size_t size)
+{
+    const Handle handle = entries.create(Entry{nullptr, false});
+    if(!handle.isNull())
+        decoder.decode(handle.getId(), data, size);
+    return handle;
+}
+
+void TextureLoader::release(Handle handle)
+{
+    Entry* entry = entries.get(handle);
+    if(entry == nullptr)
+        return;
+
+    delete entry->texture;
+    entries.destroy(handle);
+}
+
+void TextureLoader::update(size_t maxUploads)
+{
+    for(size_t i=0; i<maxUploads; ++i)
+    {
+        std::unique_ptr<ImageDecoder::Result> result = decoder.poll();
+        if(!result)
+            break;
+
+        // released while it was decoding
+        Entry* entry = entries.get(Handle::fromId(result->id));
+        if(entry == nullptr)
+            continue;
+
+        sf::Texture* texture = new sf::Texture();
+        if(result->ok && texture->loadFromImage(result->image)) {
+            entry->texture = texture;
+        }
+        else {
+            delete texture;
+            entry->failed = true;
+        }
+    }
+}
+
+void TextureLoader::finish()
+{
+    decoder.wait();
+    update(~size_t(0));
+}
+
+TextureLoader::State TextureLoader::getState(Handle handle) const
+{
+    const Entry* entry = entries.get(handle);
+    if(entry == nullptr || entry->failed)
+        return FAILED;
+    return entry->texture ? READY : LOADING;
+}
+
+sf::Texture& TextureLoader::getTexture(Handle handle)
+{
+    const Entry* entry = entries.get(handle);
+    if(entry && entry->texture)
+        return *entry->texture;
+
+    if(placeholder.getSize().x == 0) {
+        sf::Image image;
+        image.create(1, 1, sf::Color::White);
+        placeholder.loadFromImage(image);
+    }
+    return placeholder;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "config.hpp"
+#include "pool.hpp"
+
+/// ImageDecoder
+// Threads decoding image files into sf::Image, independent of the job system
+// so slow reads never hold up a frame's jobs. Nothing here touches the GPU.
+class ImageDecoder
+{
+public:
+    struct Result
+    {
+        u32         id;
+        bool        ok;
+        sf::Image   image;
+    };
+
+    explicit ImageDecoder(size_t numThreads = IO_THREADS);
+
+    // Drops the queued requests and waits for the ones being decoded
+    ~ImageDecoder();
+
+    // Queue a file, `id` comes back with its result
+    void decode(u32 id, const std::string& path);
+
+    // Queue encoded bytes, which must stay valid until the result is polled
+    void decode(u32 id, const void* data, size_t size);
+
+    // Next finished image in completion order, nullptr if there is none yet
+    std::unique_ptr<Result> poll();
+
+    // Block until every queued image is decoded
+    void wait();
+
+    // Requests queued or being decoded
+    size_t getPending() const;
+
+private:
+    ImageDecoder(const ImageDecoder&);
+    ImageDecoder& operator=(const ImageDecoder&);
+
+    struct Request
+    {
+        u32         id;
+        std::string path;
+        const void* data;
+        size_t      size;
+    };
+
+    void push(const Request& request);
+    void threadLoop();
+
+    std::vector<std::thread>    threads;
+
+    mutable std::mutex          lock;
+    std::condition_variable     wakeup;
+    std::condition_variable     idle;
+
+    std::deque<Request>         requests;
+    std::deque<Result*>         results;
+    size_t                      busy;
+    bool                        running;
+};
+
+/// TextureLoader
+// Hands out a handle per texture request right away and decodes in the
+// background. update() does the GPU upload on the calling thread, which must
+// own the GL context, a few images per call. Until then getTexture() returns
+// a 1x1 white placeholder, so callers can just ask again every frame.
+class TextureLoader
+{
+private:
+    struct Entry
+    {
+        sf::Texture*    texture;    // nullptr until uploaded
+        bool            failed;
+    };
+
+public:
+    typedef Pool<Entry>::Handle Handle;
+
+    enum State
+    {
+        LOADING,
+        READY,
+        FAILED     // also for released and null handles
+    };
+
+    // Room for `capacity` textures at once, the handles are drawn from
+    // `allocator`
+    explicit TextureLoader(size_t capacity, size_t numThreads = IO_THREADS,
+                           Allocator& allocator = mem::getDefaultAllocator());
+    ~TextureLoader();
+
+    // Null handle when every slot is taken
+    Handle load(const std::string& path);
+
+    // Encoded bytes, e.g. from an EffectPack, valid until the load finishes
+    Handle load(const void* data, size_t size);
+
+    // The texture goes away, an unfinished decode is thrown away
+    void release(Handle handle);
+
+    // Upload up to `maxUploads` decoded images
+    void update(size_t maxUploads = TEXTURE_UPLOADS);
+
+    // Decode and upload everything pending, blocking
+    void finish();
+
+    State getState(Handle handle) const;
+
+    // The placeholder until the texture is ready, and if it fails
+    sf::Texture& getTexture(Handle handle);
+
+    inline ImageDecoder& getDecoder() { return decoder; }
+
+private:
+    TextureLoader(const TextureLoader&);
+    TextureLoader& operator=(const TextureLoader&);
+
+    Pool<Entry>     entries;
+    ImageDecoder    decoder;
+    sf::Texture     placeholder;
+};
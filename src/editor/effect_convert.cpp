@@ -0,0 +1,231 @@
+#include "effect_convert.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+#include "particlefx.hpp"
+#include "particle_binary.hpp"
+#include "effect_pack.hpp"
+#include "cereal.hpp"
+#include "archives/json.hpp"
+
+namespace tools
+{
+
+namespace
+{
+    // File name without directories and extension
+    std::string effectName(const std::string& path)
+    {
+        const size_t slash = path.find_last_of("/\\");
+        const size_t begin = slash == std::string::npos ? 0 : slash + 1;
+        const size_t dot   = path.find_last_of('.');
+        return path.substr(begin, dot == std::string::npos || dot < begin ? std::string::npos : dot - begin);
+    }
+
+    // Lower case extension with the dot, empty if there is none
+    std::string extension(const std::string& path)
+    {
+        const size_t slash = path.find_last_of("/\\");
+        const size_t dot   = path.find_last_of('.');
+        if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return "";
+
+        std::string ext = path.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext;
+    }
+
+    // A JSON effect as saved by the editor, or the first effect of a binary one
+    bool loadEffect(const std::string& path, ParticleEmitter& emitter, std::string& image)
+    {
+        if(particle_binary::loadFirst(path, emitter, image))
+            return true;
+
+        try {
+            std::ifstream is(path);
+            if(!is) {
+                std::cerr << "Failed to open " << path << "\n";
+                return false;
+            }
+
+            cereal::JSONInputArchive archive(is);
+            archive(image);
+            archive(emitter);
+        }
+        catch(const cereal::Exception& e) {
+            std::cerr << "Failed to load " << path << ": " << e.what() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool readFile(const std::string& path, std::vector<char>& data)
+    {
+        std::ifstream is(path, std::ios::binary);
+        if(!is)
+            return false;
+
+        data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+        return !is.bad();
+    }
+
+    // Paths of the files under `root`, relative to it and starting with a
+    // slash like the image paths effects store
+    void listFiles(const std::string& root, const std::string& relative, std::vector<std::string>& files)
+    {
+        std::vector<std::string> dirs;
+
+        #if defined(_WIN32)
+        WIN32_FIND_DATAA info;
+        HANDLE find = FindFirstFileA((root + relative + "/*").c_str(), &info);
+        if(find == INVALID_HANDLE_VALUE)
+            return;
+
+        do {
+            const std::string name = info.cFileName;
+            if(name == "." || name == "..")
+                continue;
+
+            if(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                dirs.push_back(relative + "/" + name);
+            else
+                files.push_back(relative + "/" + name);
+        } while(FindNextFileA(find, &info));
+        FindClose(find);
+        #else
+        DIR* dir = opendir((root + relative).c_str());
+        if(dir == nullptr)
+            return;
+
+        while(dirent* d = readdir(dir)) {
+            const std::string name = d->d_name;
+            if(name == "." || name == "..")
+                continue;
+
+            struct stat info;
+            if(stat((root + relative + "/" + name).c_str(), &info) != 0)
+                continue;
+
+            if(S_ISDIR(info.st_mode))
+                dirs.push_back(relative + "/" + name);
+            else if(S_ISREG(info.st_mode))
+                files.push_back(relative + "/" + name);
+        }
+        closedir(dir);
+        #endif
+
+        // the listing order depends on the file system
+        std::sort(dirs.begin(), dirs.end());
+        for(const std::string& d : dirs)
+            listFiles(root, d, files);
+    }
+}
+
+int runConvert(int argc, char** args)
+{
+    if(argc < 2) {
+        std::cout << "Usage: Particles --convert-pfx out.pfxb effect.pfx...\n"
+                  << "  Every JSON effect becomes one record, named after its file\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<particle_binary::Entry> entries;
+    for(int i=1; i<argc; ++i)
+    {
+        particle_binary::Entry entry;
+        entry.name = effectName(args[i]);
+
+        ParticleEmitter emitter(0);
+        if(!loadEffect(args[i], emitter, entry.image))
+            return EXIT_FAILURE;
+
+        particle_binary::store(emitter, entry.effect);
+        entries.push_back(entry);
+    }
+
+    if(!particle_binary::write(args[0], entries)) {
+        std::cerr << "Failed to write " << args[0] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Wrote " << entries.size() << " effects to " << args[0] << "\n";
+    return EXIT_SUCCESS;
+}
+
+int runBuildPack(int argc, char** args)
+{
+    if(argc < 2) {
+        std::cout << "Usage: Particles --build-pack out.pack resdir\n"
+                  << "  .pfx files become effects and images stay encoded as textures, both\n"
+                  << "  named by their path under resdir, e.g. /textures/particle.png\n";
+        return EXIT_FAILURE;
+    }
+
+    const std::string out  = args[0];
+    const std::string root = args[1];
+
+    std::vector<std::string> files;
+    listFiles(root, "", files);
+
+    std::vector<effect_pack::Source> sources;
+    size_t numEffects = 0, numTextures = 0;
+
+    for(const std::string& name : files)
+    {
+        const std::string path = root + name;
+        const std::string ext  = extension(name);
+
+        // an older pack written into the same directory
+        if(ext == ".pack")
+            continue;
+
+        effect_pack::Source source;
+        source.name = name;
+
+        if(ext == ".pfx") {
+            ParticleEmitter emitter(0);
+            if(!loadEffect(path, emitter, source.image))
+                return EXIT_FAILURE;
+
+            source.type = effect_pack::TYPE_EFFECT;
+            particle_binary::store(emitter, source.effect);
+            ++numEffects;
+        }
+        else {
+            // the formats sf::Texture decodes
+            const bool image = ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" ||
+                               ext == ".tga" || ext == ".gif" || ext == ".psd" || ext == ".hdr" || ext == ".pic";
+
+            source.type = image ? effect_pack::TYPE_TEXTURE : effect_pack::TYPE_DATA;
+            if(!readFile(path, source.data)) {
+                std::cerr << "Failed to read " << path << "\n";
+                return EXIT_FAILURE;
+            }
+            numTextures += image;
+        }
+
+        sources.push_back(source);
+    }
+
+    if(!effect_pack::write(out, sources)) {
+        std::cerr << "Failed to write " << out << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Wrote " << numEffects << " effects, " << numTextures << " textures and "
+              << sources.size() - numEffects - numTextures << " other files to " << out << "\n";
+    return EXIT_SUCCESS;
+}
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace tools
+{
+    // Packs JSON .pfx effects into one binary effect file, see
+    // particle_binary. Returns the process exit code.
+    int runConvert(int argc, char** args);
+
+    // Bundles every effect, texture and other file under a directory into
+    // one pack, see effect_pack. Returns the process exit code.
+    int runBuildPack(int argc, char** args);
+}
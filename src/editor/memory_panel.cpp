@@ -0,0 +1,77 @@
+#include "memory_panel.hpp"
+
+#include "imgui.h"
+
+#include <stdio.h>
+
+namespace
+{
+    inline float kb(size_t bytes)
+    {
+        return bytes / 1024.f;
+    }
+}
+
+void MemoryPanel::update()
+{
+    ImGui::Begin("Memory");
+
+    const std::vector<TrackingAllocator*>& trackers = mem::getTrackers();
+
+    if (ImGui::Button("Reset peaks", ImVec2(100, 20))) {
+        for(auto t : trackers)
+            t->resetPeaks();
+    }
+
+    // one row per tag, the details below
+    ImGui::Columns(5, "trackers");
+    ImGui::Text("Tag");   ImGui::NextColumn();
+    ImGui::Text("KB");    ImGui::NextColumn();
+    ImGui::Text("Peak");  ImGui::NextColumn();
+    ImGui::Text("Allocs"); ImGui::NextColumn();
+    ImGui::Text("Frag");  ImGui::NextColumn();
+    ImGui::Separator();
+
+    for(auto t : trackers) {
+        ImGui::Text("%s", t->getTag().c_str());               ImGui::NextColumn();
+        ImGui::Text("%.1f", kb(t->getUsedMemory()));          ImGui::NextColumn();
+        ImGui::Text("%.1f", kb(t->getPeakMemory()));          ImGui::NextColumn();
+        ImGui::Text("%zu", t->getNumAllocations());           ImGui::NextColumn();
+        ImGui::Text("%.0f%%", t->getFragmentation() * 100.f); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    for(auto t : trackers) {
+        if (!ImGui::CollapsingHeader(t->getTag().c_str()))
+            continue;
+
+        ImGui::PushID(t);
+
+        ImGui::Text("Allocations: %zu live, %zu peak, %zu total",
+                    t->getNumAllocations(), t->getPeakAllocations(), t->getTotalAllocations());
+
+        // requests per power of two size class, from <= 16 B up
+        const size_t* counts = t->getHistogram();
+        float highest = 0;
+        for(size_t i=0; i<TrackingAllocator::HISTOGRAM_BUCKETS; ++i) {
+            histogram[i] = counts[i];
+            if(histogram[i] > highest)
+                highest = histogram[i];
+        }
+
+        snprintf(s64, sizeof(s64), "16 B .. %zu KB",
+                 TrackingAllocator::getBucketSize(TrackingAllocator::HISTOGRAM_BUCKETS-2) / 1024);
+        ImGui::PlotHistogram("Sizes", histogram, TrackingAllocator::HISTOGRAM_BUCKETS, 0, s64, 0, highest, ImVec2(0, 60));
+
+        const std::vector<TrackingAllocator::CallSite> sites = t->getCallSites();
+        for(const auto& site : sites) {
+            ImGui::BulletText("%s:%d  %zu allocs, %.1f KB",
+                              site.file ? site.file : "unknown", site.line, site.numAllocs, kb(site.size));
+        }
+
+        ImGui::PopID();
+    }
+
+    ImGui::End();
+}
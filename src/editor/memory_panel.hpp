@@ -0,0 +1,13 @@
+#pragma once
+
+#include "alloc.hpp"
+
+// Live view of every TrackingAllocator, see mem::getTrackers()
+struct MemoryPanel
+{
+    void update();
+
+private:
+    float histogram[TrackingAllocator::HISTOGRAM_BUCKETS];
+    char s64[64];
+};
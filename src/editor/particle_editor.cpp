@@ -5,22 +5,48 @@
 #include "cereal.hpp"
 #include "archives/json.hpp"
 #include "types/vector.hpp"
+#include "particle_binary.hpp"
 
 #include "tinyfiledialogs.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
-bool ParticleEditor::setup(const std::string& respath, const std::string& imgpath)
+bool ParticleEditor::setup(const std::string& respath, const std::string& imgpath, TextureLoader& textures,
+                           EffectPack* pack, const TextureAtlas* atlas)
 {
+    this->pack = pack;
+    this->atlas = atlas;
+    this->textures = &textures;
     this->respath = respath;
     this->imgpath = imgpath;
 
-    if(!texture.loadFromFile(respath+imgpath)) return false;
+    if(!loadTexture()) return false;
 
     return true;
 }
 
+bool ParticleEditor::loadTexture()
+{
+    // the shown image stays until this one is uploaded, see update()
+    textures->release(pending);
+    pending = TextureLoader::Handle();
+
+    sf::Texture* page;
+    sf::IntRect rect;
+    if(atlas && atlas->find(imgpath, page, rect))
+        return true;
+
+    const effect_pack::Entry* entry = pack ? pack->find(imgpath) : nullptr;
+    if(entry && entry->type == effect_pack::TYPE_TEXTURE)
+        pending = textures->load(pack->getData(*entry), entry->size);
+    else
+        pending = textures->load(respath+imgpath);
+
+    return !pending.isNull();
+}
+
 void ParticleEditor::save(ParticleEmitter& particles)
 {
     const char* path = tinyfd_saveFileDialog("Save", "", 0, NULL, NULL);
@@ -36,13 +62,32 @@ void ParticleEditor::open(ParticleEmitter& particles)
 {
     const char* path = tinyfd_openFileDialog("Open", "", 0, NULL, NULL, 0);
     if (path) {
-        std::ifstream is(path);
-        cereal::JSONInputArchive archive(is);
-        archive(imgpath);
-        archive(particles);
+        // binary effect files are recognized by their header
+        if(!particle_binary::loadFirst(path, particles, imgpath)) {
+            try {
+                std::ifstream is(path);
+                cereal::JSONInputArchive archive(is);
+                archive(imgpath);
+                archive(particles);
+            }
+            catch(const cereal::Exception& e) {
+                std::cout << "Failed to open " << path << ": " << e.what() << "\n";
+                return;
+            }
+        }
 
         particles.resize(particles.count);
-        texture.loadFromFile(respath+imgpath);
+        particles.resetAll();
+        loadTexture();
+    }
+}
+
+void ParticleEditor::open(ParticleEmitter& particles, const std::string& name)
+{
+    if (pack && pack->loadEffect(name, particles, imgpath)) {
+        particles.resize(particles.count);
+        particles.resetAll();
+        loadTexture();
     }
 }
 
@@ -56,7 +101,7 @@ void ParticleEditor::update(ParticleEmitter& particles, const sf::Time& elapsed)
     }
 
     if (ImGui::Button("Load image", ImVec2(100, 20))) {
-        texture.loadFromFile(respath+imgpath);
+        loadTexture();
     }
 
     i1 = particles.count;
@@ -68,6 +113,25 @@ void ParticleEditor::update(ParticleEmitter& particles, const sf::Time& elapsed)
         particles.resize(particles.count);
     }
 
+    f1 = particles.rate;
+    if (ImGui::InputFloat("Rate", &f1)) {
+        particles.rate = f1;
+    }
+
+    i1 = particles.burst;
+    if (ImGui::InputInt("Burst", &i1)) {
+        particles.burst = i1;
+    }
+
+    if (ImGui::Button("Emit burst", ImVec2(100, 20))) {
+        particles.emit(particles.burst);
+    }
+
+    i1 = particles.seed;
+    if (ImGui::InputInt("Seed", &i1)) {
+        particles.seed = i1;
+    }
+
     f2[0] = particles.emitter.x;
     f2[1] = particles.emitter.y;
 
@@ -129,6 +193,26 @@ void ParticleEditor::update(ParticleEmitter& particles, const sf::Time& elapsed)
         particles.maxSize = f2[1];
     }
 
+    i2[0] = particles.frameColumns;
+    i2[1] = particles.frameRows;
+
+    if (ImGui::InputInt2("Frame grid", i2)) {
+        particles.frameColumns = std::max(i2[0], 1);
+        particles.frameRows = std::max(i2[1], 1);
+    }
+
+    i1 = particles.frameCount;
+    if (ImGui::InputInt("Frame count", &i1)) {
+        particles.frameCount = std::max(i1, 0);
+    }
+
+    f1 = particles.frameRate;
+    if (ImGui::InputFloat("Frame rate", &f1)) {
+        particles.frameRate = std::max(f1, 0.f);
+    }
+
+    ImGui::Checkbox("Random start frame", &particles.randomStartFrame);
+
     f3[0] = particles.startColor.r / 255.f;
     f3[1] = particles.startColor.g / 255.f;
     f3[2] = particles.startColor.b / 255.f;
@@ -149,20 +233,43 @@ void ParticleEditor::update(ParticleEmitter& particles, const sf::Time& elapsed)
         particles.endColor.b = static_cast<sf::Uint8>(f3[2] * 255.f);
     }
 
-    if (ImGui::RadioButton("BlendAdd", &i1, 0)) {
+    // the selection follows the emitter, not whatever field was edited last
+    int blend = particles.blendMode == sf::BlendAdd      ? 0 :
+                particles.blendMode == sf::BlendAlpha    ? 1 :
+                particles.blendMode == sf::BlendMultiply ? 2 :
+                particles.blendMode == sf::BlendNone     ? 3 : -1;
+
+    if (ImGui::RadioButton("BlendAdd", &blend, 0)) {
         particles.blendMode = sf::BlendAdd;
     }
-    if (ImGui::RadioButton("BlendAlpha", &i1, 1)) {
+    if (ImGui::RadioButton("BlendAlpha", &blend, 1)) {
         particles.blendMode = sf::BlendAlpha;
     }
-    if (ImGui::RadioButton("BlendMultiply", &i1, 2)) {
+    if (ImGui::RadioButton("BlendMultiply", &blend, 2)) {
         particles.blendMode = sf::BlendMultiply;
     }
-    if (ImGui::RadioButton("BlendNone", &i1, 3)) {
+    if (ImGui::RadioButton("BlendNone", &blend, 3)) {
         particles.blendMode = sf::BlendNone;
     }
 
     ImGui::End();
 
-    particles.setTexture(&texture);
+    const TextureLoader::State state = textures->getState(pending);
+    if (state == TextureLoader::READY) {
+        textures->release(image);
+        image = pending;
+        pending = TextureLoader::Handle();
+    }
+    else if (state == TextureLoader::FAILED && !pending.isNull()) {
+        std::cout << "Failed to load image " << imgpath << "\n";
+        textures->release(pending);
+        pending = TextureLoader::Handle();
+    }
+
+    sf::Texture* page;
+    sf::IntRect rect;
+    if (atlas && atlas->find(imgpath, page, rect))
+        particles.setTexture(page, rect);
+    else
+        particles.setTexture(&textures->getTexture(image));
 }
@@ -2,10 +2,16 @@
 
 #include <SFML/Graphics.hpp>
 #include "particlefx.hpp"
+#include "effect_pack.hpp"
+#include "texture_loader.hpp"
+#include "texture_atlas.hpp"
 
 struct ParticleEditor
 {
-    bool setup(const std::string& respath, const std::string& imgpath);
+    // Images found in `atlas` are used from there, the others load in the
+    // background through `textures`, from `pack` before respath
+    bool setup(const std::string& respath, const std::string& imgpath, TextureLoader& textures,
+               EffectPack* pack = nullptr, const TextureAtlas* atlas = nullptr);
 
     void update(ParticleEmitter& particles, const sf::Time& elapsed);
 
@@ -13,10 +19,19 @@ struct ParticleEditor
 
     void open(ParticleEmitter& particles);
 
+    // Open an effect of the pack given to setup()
+    void open(ParticleEmitter& particles, const std::string& name);
+
 private:
+    bool loadTexture();
+
+    EffectPack* pack;
+    const TextureAtlas* atlas;
+    TextureLoader* textures;
+    TextureLoader::Handle image;
+    TextureLoader::Handle pending;
     std::string respath;
     std::string imgpath;
-    sf::Texture texture;
 
     char s512[512];
     char s1024[1024];
@@ -0,0 +1,91 @@
+// Utility header for fast, seedable random streams.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief xoshiro128+ generator
+ * Small state, no global locks, and the same sequence for the same seed
+ * on every platform. Good enough for visuals, not for cryptography.
+ */
+struct Random
+{
+    explicit Random (uint64_t seed = 0) { reseed(seed); }
+
+    /**
+     * @brief reseed
+     * @param seed value
+     * Expands the seed with splitmix64 so nearby seeds give unrelated streams
+     */
+    inline void reseed (uint64_t seed)
+    {
+        for (int i = 0; i < 4; ++i)
+            state[i] = static_cast<uint32_t>(splitmix64(seed) >> 32);
+    }
+
+    /**
+     * @brief next
+     * @return next 32 random bits
+     */
+    inline uint32_t next ()
+    {
+        const uint32_t result = state[0] + state[3];
+        const uint32_t t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = (state[3] << 11) | (state[3] >> 21);
+
+        return result;
+    }
+
+    /**
+     * @brief uniform
+     * @return float in [0, 1)
+     */
+    inline float uniform ()
+    {
+        // the upper 24 bits are the strongest ones of xoshiro128+
+        return (next() >> 8) * (1.f / 16777216.f);
+    }
+
+    /**
+     * @brief fill
+     * @param out array
+     * @param count number of floats
+     * out[0..count) = uniform()
+     */
+    inline void fill (float* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = uniform();
+    }
+
+    /**
+     * @brief hash
+     * @param a value
+     * @param b value
+     * @return well mixed combination of a and b, to derive stream seeds
+     */
+    static inline uint64_t hash (uint64_t a, uint64_t b)
+    {
+        uint64_t x = a ^ (b * 0x9E3779B97F4A7C15ull);
+        return splitmix64(x);
+    }
+
+private:
+    static inline uint64_t splitmix64 (uint64_t& x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t state[4];
+};